@@ -0,0 +1,147 @@
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <horde3d.h>
+
+#include "../common.h"
+
+#include "../texture_manager.h"
+
+#include "../h3d.h"
+
+/*
+  texgen-batch links this in place of h3d.cpp and libHorde3D. texture resources
+  are plain buffers in memory so TextureManager works unchanged, the model and
+  material functions do nothing. seeds run concurrently share the resources, the
+  map is locked, the streams of different resources are used independently.
+*/
+
+namespace
+{
+  struct _Resource
+  {
+    std::string name;
+    int width, height;
+    std::vector<uint8_t> stream;
+  };
+
+  std::mutex _lock;
+  std::map<H3DRes, _Resource> _resources;
+  H3DRes _next_res = 1;
+  int _res_loaded = 0;
+}
+
+const char* h3dGetResName(H3DRes res)
+{
+  std::lock_guard<std::mutex> lock(_lock);
+  auto it = _resources.find(res);
+  return it == _resources.end() ? "" : it->second.name.c_str();
+}
+
+int h3dRemoveResource(H3DRes res)
+{
+  std::lock_guard<std::mutex> lock(_lock);
+  _resources.erase(res);
+  return 0;
+}
+
+void h3dUnloadResource(H3DRes){}
+
+int h3dGetResParamI(H3DRes res, int elem, int, int param)
+{
+  std::lock_guard<std::mutex> lock(_lock);
+  auto it = _resources.find(res);
+  if(it == _resources.end() || elem != H3DTexRes::ImageElem)
+    return 0;
+  switch(param)
+  {
+  case H3DTexRes::ImgWidthI:
+    return it->second.width;
+  case H3DTexRes::ImgHeightI:
+    return it->second.height;
+  default:
+    return 0;
+  }
+}
+
+void* h3dMapResStream(H3DRes res, int, int, int, bool, bool)
+{
+  std::lock_guard<std::mutex> lock(_lock);
+  auto it = _resources.find(res);
+  return it == _resources.end() ? nullptr : it->second.stream.data();
+}
+
+void h3dUnmapResStream(H3DRes){}
+
+H3DRes h3dCreateTexture(const char* name, int width, int height, int, int)
+{
+  std::lock_guard<std::mutex> lock(_lock);
+  H3DRes res = _next_res++;
+  _resources[res] = _Resource{name, width, height,
+    std::vector<uint8_t>((size_t)width * height * 4)};
+  return res;
+}
+
+namespace H3D
+{
+  void setPipeline(const char*){}
+  void setPipeline(const char*, size_t){}
+  void setGeo(const char*){}
+  void setGeo(const char*, size_t){}
+  void setGeo(
+    std::vector<float>,
+    std::vector<float>,
+    std::vector<float>,
+    std::vector<float>,
+    std::vector<float>,
+    std::vector<float>,
+    std::vector<unsigned>,
+    bool){}
+  void setShader(const char*){}
+  void setShader(const char*, size_t){}
+
+  void setUniform(const char*, float, float, float, float){}
+  void removeUniform(const char*){}
+  void enableShaderFlag(int){}
+  void disableShaderFlag(int){}
+  void enableRenderStage(const char*){}
+  void disableRenderStage(const char*){}
+
+  //decoding images is left to Horde3D
+  int loadTexture(const char*)
+  {
+    throw tgException("loading textures is not available in texgen-batch");
+  }
+  int loadTexture(const char*, size_t)
+  {
+    throw tgException("loading textures is not available in texgen-batch");
+  }
+  void bindSampler(int, const char*){}
+  void unbindSampler(const char*){}
+  void replaceSamplerRes(const char*, const char*){}
+
+  H3DRes createTexture(int w, int h)
+  {
+    char res_name[64];
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      snprintf(res_name, 64, "_res%i", _res_loaded++);
+    }
+    return h3dCreateTexture(res_name, w, h, H3DFormats::TEX_BGRA8, 0);
+  }
+
+  void dumpMessages(){}
+  void dumpMessagesToStdout(){}
+
+  void init()
+  {
+    TextureManager::init();
+  }
+  void deinit() noexcept
+  {
+    TextureManager::deinit();
+  }
+}
@@ -0,0 +1,184 @@
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "../common.h"
+
+#include "../sq.h"
+#include "../h3d.h"
+#include "../rand.h"
+#include "../tex_op.h"
+#include "../texture_manager.h"
+#include "../thread_pool.h"
+
+/*
+  texgen-batch, runs the scripts given on the command line without opening a
+  window, and exits. outputs are written by the scripts (saveBMP), the exit code
+  is nonzero if any script failed.
+
+  with -s the scripts are run once per seed, with the seed in the root table
+  variable 'seed'. -j runs are executed at a time, each on a thread of it's own
+  with it's own vm, random devices and textures. the runs share the thread pool,
+  which is shrunk so the runs and the workers together don't outnumber the cores.
+*/
+
+namespace
+{
+  struct _SeedRuns
+  {
+    std::vector<const char*> scripts;
+    std::atomic<int> next;
+    int end;
+    std::atomic<int> failed;
+  };
+
+  //runs the scripts, counting those which fail
+  int _runScripts(const std::vector<const char*>& scripts, const char* prefix)
+  {
+    int failed = 0;
+    for(const char* script: scripts)
+    {
+      try
+      {
+        Sq::executeNutRawPath(script);
+      }
+      catch(std::exception& e)
+      {
+        printf("%s%s: %s\n", prefix, script, e.what());
+        ++failed;
+      }
+    }
+    return failed;
+  }
+
+  void _seedWorker(_SeedRuns* runs)
+  {
+    ThreadPool::Client client(TexOp::threadPool());
+
+    for(int seed = runs->next++; seed < runs->end; seed = runs->next++)
+    {
+      char prefix[32];
+      snprintf(prefix, 32, "seed %i: ", seed);
+
+      TextureManager::Instance* inst = TextureManager::createInstance();
+      TextureManager::setInstance(inst);
+      Rand::clearDevices();
+      try
+      {
+        Sq::init();
+        sq_pushroottable(Sq::vm);
+        sq_pushstring(Sq::vm, "seed", -1);
+        sq_pushinteger(Sq::vm, seed);
+        sq_newslot(Sq::vm, -3, SQFalse);
+        sq_pop(Sq::vm, 1);
+
+        runs->failed += _runScripts(runs->scripts, prefix);
+      }
+      catch(std::exception& e)
+      {
+        printf("%s%s\n", prefix, e.what());
+        ++runs->failed;
+      }
+      Sq::deinit();
+      TextureManager::destroyInstance(inst);
+    }
+  }
+
+  int _runSeeds(_SeedRuns& runs, int jobs)
+  {
+    int cores = std::thread::hardware_concurrency();
+    if(cores < 1) cores = 1;
+    TexOp::threadPool().start(cores > jobs? cores - jobs : 0, jobs);
+
+    std::vector<std::thread> threads;
+    for(int i = 0; i < jobs; ++i)
+      threads.emplace_back(_seedWorker, &runs);
+    for(auto& thread: threads)
+      thread.join();
+
+    return runs.failed;
+  }
+
+  void _usage(const char* name)
+  {
+    printf("usage: %s [-j jobs] [-s first:count] script.nut [script.nut ...]\n", name);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  //set app_path
+  using Common::app_path;
+  app_path = argv[0];
+
+  if( app_path.find( "/" ) != std::string::npos )
+    app_path.erase(app_path.rfind("/") + 1);
+  else if( app_path.find( "\\" ) != std::string::npos )
+    app_path.erase(app_path.rfind("\\") + 1);
+  else
+    app_path.clear();
+
+  _SeedRuns runs;
+  runs.next = 0;
+  runs.end = 0;
+  runs.failed = 0;
+  bool seeded = false;
+  int jobs = std::thread::hardware_concurrency();
+
+  for(int i = 1; i < argc; ++i)
+  {
+    if(strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+      jobs = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+    {
+      int first, count;
+      if(sscanf(argv[++i], "%i:%i", &first, &count) != 2 || count < 0)
+      {
+        _usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      runs.next = first;
+      runs.end = first + count;
+      seeded = true;
+    }
+    else
+      runs.scripts.push_back(argv[i]);
+  }
+  if(jobs < 1) jobs = 1;
+
+  if(runs.scripts.empty())
+  {
+    _usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  int failed = 0;
+
+  try
+  {
+    H3D::init();
+
+    if(seeded)
+      failed = _runSeeds(runs, jobs);
+    else
+    {
+      Sq::init();
+      failed = _runScripts(runs.scripts, "");
+    }
+  }
+  catch(std::exception& e)
+  {
+    printf("\nunrecoverable error: %s\nexiting\n", e.what());
+    failed = 1;
+  }
+
+  Sq::deinit();
+  H3D::deinit();
+
+  fflush(stdout);
+
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,41 @@
+#include <cstdio>
+
+#include "../terminal.h"
+
+//texgen-batch has no console overlay, everything printed goes to stdout
+
+namespace Terminal
+{
+  void printfm(const char* format, ...)
+  {
+    va_list args;
+    va_start(args, format);
+    std::vprintf(format, args);
+    va_end(args);
+  }
+
+  void print(const char* arg)
+  {
+    std::fputs(arg, stdout);
+  }
+
+  void println(const char* arg)
+  {
+    std::puts(arg);
+  }
+
+  void rebuild(){}
+  void update(){}
+  void feedCharacter(char){}
+  void moveCaret(int){}
+  void exploreHistory(int){}
+  void updateSymbols(){}
+  void toggle(){}
+  void start(){}
+  void stop(){}
+
+  H3DRes init()
+  {
+    return 0;
+  }
+}
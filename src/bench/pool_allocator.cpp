@@ -0,0 +1,134 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../pool_allocator.h"
+
+/*
+  pool-bench, compares the allocators of pool_allocator.h with malloc. each thread
+  allocates a batch of cells and frees them again, over and over, the time is given
+  per allocate/deallocate pair.
+*/
+
+namespace
+{
+  constexpr unsigned _cell_size = 128;
+  constexpr unsigned _pool_size = 4096;
+
+  typedef PoolAllocator<_cell_size, _pool_size> _Pool;
+  typedef ConcurrentPoolAllocator<_cell_size, _pool_size> _ConcurrentPool;
+
+  //PoolAllocator is not thread safe, it's shared behind a mutex
+  struct _LockedPool
+  {
+    std::mutex lock;
+    _Pool pool;
+
+    void* allocate()
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      return pool.allocate();
+    }
+    void deallocate(void* block)
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      pool.deallocate(block);
+    }
+  };
+
+  struct _Malloc
+  {
+    void* allocate()
+    {
+      return malloc(_cell_size);
+    }
+    void deallocate(void* block)
+    {
+      free(block);
+    }
+  };
+
+  template<class A>
+  void _run(A& allocator, unsigned batch, unsigned rounds)
+  {
+    std::vector<void*> cells(batch);
+    for(unsigned r = 0; r < rounds; ++r)
+    {
+      for(auto& cell: cells)
+      {
+        cell = allocator.allocate();
+        //touch the cell, so it's cache line is moved to this thread
+        *(volatile char*)cell = 0;
+      }
+      for(auto cell: cells)
+        allocator.deallocate(cell);
+    }
+  }
+
+  //ns per allocate/deallocate pair
+  template<class A>
+  double _measure(unsigned threads, unsigned batch, unsigned pairs)
+  {
+    A allocator;
+    unsigned rounds = pairs / batch / threads;
+    //warm up, so the pools are reserved and the magazines filled
+    _run(allocator, batch, 1);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for(unsigned t = 0; t < threads; ++t)
+      workers.emplace_back([&](){_run(allocator, batch, rounds);});
+    for(auto& worker: workers)
+      worker.join();
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::nano>(end - start).count() /
+      ((double)rounds * batch * threads);
+  }
+
+  void _usage(const char* name)
+  {
+    printf("usage: %s [-t threads] [-n pairs]\n", name);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  unsigned threads = 4;
+  unsigned pairs = 1 << 24;
+
+  for(int i = 1; i < argc; ++i)
+  {
+    if(strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+      threads = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+      pairs = atoi(argv[++i]);
+    else
+    {
+      _usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if(threads < 1) threads = 1;
+
+  printf("%u byte cells, %u pairs, ns per allocate/deallocate pair\n",
+    _cell_size, pairs);
+  printf("%-8s %-6s %12s %12s %12s\n",
+    "threads", "batch", "mutex+pool", "concurrent", "malloc");
+  for(unsigned t: {1u, threads})
+  {
+    for(unsigned batch: {4u, 64u})
+      printf("%-8u %-6u %12.1f %12.1f %12.1f\n", t, batch,
+        _measure<_LockedPool>(t, batch, pairs),
+        _measure<_ConcurrentPool>(t, batch, pairs),
+        _measure<_Malloc>(t, batch, pairs));
+    if(threads == 1)
+      break;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -2,27 +2,30 @@
 #define BLURFILTER_H_INCLUDED
 
 #include <cassert>
+#include <cmath>
 
 #include <memory>
 
+/*
+  the taps of the binomial filters are built as doubles, which hold them exactly up
+  to level 33, and handed to the kernels as floats. the kernels divide by weight
+  after adding up the taps, so the taps and their products with the texels must
+  stay within float range. the taps of a filter of level n (the product of two
+  filters has the sum of their levels) add up to 3^n, max_level keeps that well
+  inside of float range.
+*/
 class BlurFilter2d
 {
-  std::unique_ptr<unsigned[]> _filter;
+  std::unique_ptr<float[]> _filter;
   
   BlurFilter2d(): _filter(nullptr), width(0), height(0){}
   
-  void _adjustWeight()
-  {
-    weight = 0;
-    for(unsigned i = 0; i < width * height; ++i)
-      weight += _filter[i];
-  }
-  
 public:
 
-  unsigned width, height, weight;
+  unsigned width, height;
+  float weight;
 
-  unsigned& get(unsigned x, unsigned y)
+  float& get(unsigned x, unsigned y)
   {
     return _filter[x + y * width];
   }
@@ -36,41 +39,68 @@ public:
 
 class BlurFilter1d
 {
-  std::unique_ptr<unsigned[]> _filter;
+  std::unique_ptr<double[]> _taps;
+  std::unique_ptr<float[]> _filter;
+  double _weight;
   
   void _blurOut()
   {
     unsigned new_size = size + 2;
-    std::unique_ptr<unsigned[]> new_filter(new unsigned[new_size]);
+    std::unique_ptr<double[]> new_taps(new double[new_size]);
     for(unsigned i = 0; i < new_size; ++i)
-      new_filter[i] = 0;
+      new_taps[i] = 0;
     for(unsigned i = 0; i < size; ++i)
     {
-      new_filter[i    ] += _filter[i];
-      new_filter[i + 1] += _filter[i];
-      new_filter[i + 2] += _filter[i];
+      new_taps[i    ] += _taps[i];
+      new_taps[i + 1] += _taps[i];
+      new_taps[i + 2] += _taps[i];
     }
     
     size = new_size;
-    _filter = std::move(new_filter);
+    _taps = std::move(new_taps);
   }
   
   void _adjustWeight()
   {
-    weight = 0;
+    _weight = 0;
+    _filter.reset(new float[size]);
     for(unsigned i = 0; i < size; ++i)
-      weight += _filter[i];
+    {
+      _weight += _taps[i];
+      _filter[i] = _taps[i];
+    }
+    weight = _weight;
+  }
+  
+  BlurFilter2d _product(const BlurFilter1d& other) const
+  {
+    assert(size / 2 + other.size / 2 <= max_level);
+    BlurFilter2d filt;
+    
+    filt.width = size;
+    filt.height = other.size;
+    filt._filter.reset(new float[filt.width * filt.height]);
+    
+    for(unsigned y = 0; y < filt.height; ++y)
+    for(unsigned x = 0; x < filt.width; ++x)
+      filt.get(x, y) = _taps[x] * other._taps[y];
+    filt.weight = _weight * other._weight;
+    
+    return filt;
   }
   
 public:
 
-  unsigned size, weight;
+  static constexpr unsigned max_level = 64;
+
+  unsigned size;
+  float weight;
 
   BlurFilter1d& make(unsigned level)
   {
-    assert(level >= 0);
-    _filter.reset(new unsigned[1]);
-    _filter[0] = 1;
+    assert(level <= max_level);
+    _taps.reset(new double[1]);
+    _taps[0] = 1;
     size = 1;
     for(unsigned i = 0; i < level; ++i)
       _blurOut();
@@ -81,52 +111,65 @@ public:
   
   BlurFilter2d square()
   {
-    BlurFilter2d filt;
-    
-    filt.width = size;
-    filt.height = size;
-    filt._filter.reset(new unsigned[filt.width * filt.height]);
-    
-    for(unsigned y = 0; y < filt.height; ++y)
-    for(unsigned x = 0; x < filt.width; ++x)
-      filt.get(x, y) = _filter[x] * _filter[y];
-      
-    filt._adjustWeight();
-    
-    return filt;
+    return _product(*this);
   }
   
   BlurFilter2d operator* (const BlurFilter1d& other)
   {
-    BlurFilter2d filt;
-    
-    filt.width = size;
-    filt.height = other.size;
-    filt._filter.reset(new unsigned[filt.width * filt.height]);
-    
-    for(unsigned y = 0; y < filt.height; ++y)
-    for(unsigned x = 0; x < filt.width; ++x)
-      filt.get(x, y) = _filter[x] * other._filter[y];
-    
-    filt._adjustWeight();
-    
-    return filt;
+    return _product(other);
   }
   
-  unsigned& get(unsigned idx)
+  float& get(unsigned idx)
   {
     return _filter[idx];
   }
   double getWeighted(unsigned idx)
   {
-    return (double)_filter[idx] / weight;
+    return _taps[idx] / _weight;
   }
 
-  BlurFilter1d(): _filter(nullptr), size(0){}
+  BlurFilter1d(): _taps(nullptr), _filter(nullptr), size(0){}
   BlurFilter1d(unsigned level)
   {
     make(level);
   }
 };
 
+/*
+  a set of box filters which, applied in sequence, approximate BlurFilter1d of the
+  same level. each level of BlurFilter1d convolves with [1 1 1], adding 2/3 to the
+  variance, the box sizes are chosen to match that variance as closely as possible.
+  a box filter can be applied with a running sum, so the cost per texel does not
+  depend on the level.
+*/
+class BoxFilter1d
+{
+public:
+
+  static constexpr unsigned passes = 3;
+
+  unsigned radius[passes];
+
+  BoxFilter1d& make(unsigned level)
+  {
+    const double variance = level * 2. / 3.;
+    int lower = (int)std::sqrt(12. * variance / passes + 1.);
+    if(lower % 2 == 0) --lower;
+    int upper = lower + 2;
+    int num_lower = (int)std::round(
+      (12. * variance - passes * lower * lower - 4. * passes * lower - 3. * passes)
+      / (-4. * lower - 4.));
+
+    for(unsigned i = 0; i < passes; ++i)
+      radius[i] = ((int)i < num_lower? lower : upper) / 2;
+
+    return *this;
+  }
+
+  BoxFilter1d(unsigned level)
+  {
+    make(level);
+  }
+};
+
 #endif
@@ -181,10 +181,13 @@ class Delaunay
     }
     ~__VertCon()
     {
-      for(auto& c: connections)
-      {
-        if(c) c->disconnect_ow(*this);
-      }
+      //the vertices connected through more point back at this, not at more
+      for(__VertCon* ptr = this; ptr; ptr = ptr->more.get())
+        for(auto& c: ptr->connections)
+        {
+          if(c) c->disconnect_ow(*this);
+          c = nullptr;
+        }
     }
 
     friend bool isConnected(const __VertCon& a, const __VertCon& b)
@@ -38,9 +38,24 @@
   usage:
   
   simply declare a PoolAllocator object and overload the new and delete operators for
-  the object you want to pool.
+  the object you want to pool. ConcurrentPoolAllocator is used the same way, from any
+  number of threads.
 */
 
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 /**
   @brief Pool allocator template.
   @param CellSize Size in bytes of each object allocated in the pool.
@@ -158,7 +173,7 @@ public:
 
     for(auto& chunk: _memory)
     {
-      delete chunk;
+      delete[] chunk;
       chunk = nullptr;
     }
   }
@@ -178,4 +193,373 @@ public:
   }
 };
 
-#endif
\ No newline at end of file
+namespace PoolAllocatorDetail
+{
+  constexpr unsigned MaxThreads = 64;
+
+  /*
+    the threads are numbered from 0, a number is reused once it's thread is gone.
+    threads past MaxThreads get -1.
+  */
+  class ThreadSlots
+  {
+    std::mutex _lock;
+    std::vector<int> _free;
+    int _next = 0;
+
+  public:
+    int acquire()
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      if(!_free.empty())
+      {
+        int slot = _free.back();
+        _free.pop_back();
+        return slot;
+      }
+      return _next < (int)MaxThreads? _next++ : -1;
+    }
+    void release(int slot)
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      if(slot >= 0)
+        _free.push_back(slot);
+    }
+  };
+
+  inline ThreadSlots& threadSlots()
+  {
+    static ThreadSlots slots;
+    return slots;
+  }
+
+  inline int threadSlot()
+  {
+    struct Slot
+    {
+      int slot;
+      Slot(): slot(threadSlots().acquire()){}
+      ~Slot(){threadSlots().release(slot);}
+    };
+    thread_local Slot slot;
+    return slot.slot;
+  }
+
+  /*
+    a fence on both sides of a handshake, where one side runs much more often than
+    the other. where the kernel has membarrier the frequent side only keeps the
+    compiler from reordering, and the rare side makes every other running thread of
+    the process execute a full fence. elsewhere both sides run a full fence.
+  */
+#if defined(__linux__) && defined(__NR_membarrier)
+  //the commands of linux/membarrier.h, which older headers lack
+  constexpr int MembarrierPrivateExpedited = 1 << 3;
+  constexpr int MembarrierRegisterPrivateExpedited = 1 << 4;
+
+  inline bool hasMembarrier()
+  {
+    static const bool has = syscall(__NR_membarrier,
+      MembarrierRegisterPrivateExpedited, 0) == 0;
+    return has;
+  }
+  inline void lightFence()
+  {
+    if(hasMembarrier())
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+    else
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+  inline void heavyFence()
+  {
+    if(!hasMembarrier() ||
+      syscall(__NR_membarrier, MembarrierPrivateExpedited, 0) != 0)
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+#else
+  inline void lightFence()
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+  inline void heavyFence()
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+#endif
+}
+
+/**
+  @brief Thread safe pool allocator template.
+  
+  Like PoolAllocator, but allocate and deallocate may be called by any number of
+  threads at once, and a cell may be deallocated by another thread than the one which
+  allocated it.
+  
+  Each thread keeps the last cells it deallocated in a magazine of it's own, and
+  allocates from it first, without locking or compare and swap. The other free cells are kept
+  in a lock free list. The links of the list are kept apart from the cells, and the
+  head holds the index of the first cell together with a tag changed by every update,
+  so a cell taken and given back between the reads of another thread (ABA) fails it's
+  compare and swap instead of corrupting the list.
+  
+  Allocate and deallocate mark their thread busy while they run, in the cache line of
+  it's magazine. Clear waits for the busy threads to finish, and keeps the others out
+  until the pools are gone.
+  
+  @param CellSize Size in bytes of each object allocated in the pool.
+  @param PoolSize Number of objects per pool.
+  @param MaxPools Maximum number of pools. default: 64
+  @param MagazineSize Number of cells each thread keeps. default: 8
+*/
+template<unsigned CellSize, unsigned PoolSize, unsigned MaxPools = 64,
+  unsigned MagazineSize = 8>
+class ConcurrentPoolAllocator
+{
+private:
+
+  union Block
+  {
+    char padding[CellSize];
+    std::max_align_t align;
+  };
+  
+  struct Pool
+  {
+    Block cells[PoolSize];
+    //index + 1 of the next free cell, 0 ends the list
+    std::atomic<uint32_t> next[PoolSize];
+  };
+  
+  //a cache line each, the magazines of different threads are written concurrently
+  struct alignas(64) Magazine
+  {
+    void* cells[MagazineSize];
+    unsigned count;
+    std::atomic<bool> busy;
+  };
+
+  std::atomic<Pool*> _memory[MaxPools];
+  //tag in the high 32 bits, index + 1 of the first free cell in the low
+  std::atomic<uint64_t> _head;
+  std::mutex _reserve_lock;
+  Magazine _magazines[PoolAllocatorDetail::MaxThreads];
+  //threads past MaxThreads have no magazine, they are counted here while busy
+  std::atomic<unsigned> _busy;
+  std::atomic<bool> _clearing;
+  //held by clear, threads kept out wait on it
+  std::mutex _clear_lock;
+  
+  static uint64_t _makeHead(uint64_t old_head, uint32_t first)
+  {
+    return (((old_head >> 32) + 1) << 32) | first;
+  }
+  
+  /*
+    the busy mark is stored before _clearing is read, and clear stores _clearing
+    before reading the marks, with a fence between on both sides, so either the
+    thread backs out or clear waits for it.
+  */
+  void _enter(int slot)
+  {
+    for(;;)
+    {
+      if(slot >= 0)
+        _magazines[slot].busy.store(true, std::memory_order_relaxed);
+      else
+        _busy.fetch_add(1, std::memory_order_relaxed);
+      PoolAllocatorDetail::lightFence();
+      if(!_clearing.load(std::memory_order_acquire))
+        return;
+      _leave(slot);
+      std::lock_guard<std::mutex> lock(_clear_lock);
+    }
+  }
+  
+  void _leave(int slot)
+  {
+    if(slot >= 0)
+      _magazines[slot].busy.store(false, std::memory_order_release);
+    else
+      _busy.fetch_sub(1, std::memory_order_release);
+  }
+  
+  std::atomic<uint32_t>& _link(uint32_t idx)
+  {
+    return _memory[idx / PoolSize].load(std::memory_order_relaxed)->next[idx % PoolSize];
+  }
+  
+  void _push(uint32_t idx)
+  {
+    uint64_t head = _head.load(std::memory_order_relaxed);
+    do
+      _link(idx).store((uint32_t)head, std::memory_order_relaxed);
+    while(!_head.compare_exchange_weak(head, _makeHead(head, idx + 1),
+      std::memory_order_release, std::memory_order_relaxed));
+  }
+  
+  uint32_t _index(void* block)
+  {
+    for(unsigned p = 0; p < MaxPools; ++p)
+    {
+      Pool* pool = _memory[p].load(std::memory_order_acquire);
+      if(pool != nullptr && block >= (void*)pool->cells &&
+        block < (void*)(pool->cells + PoolSize))
+        return p * PoolSize + ((Block*)block - pool->cells);
+    }
+    //pushing any cell would hand it out twice
+    std::abort();
+  }
+  
+  bool _addPool()
+  {
+    for(unsigned p = 0; p < MaxPools; ++p)
+      if(_memory[p].load(std::memory_order_relaxed) == nullptr)
+      {
+        Pool* pool = new Pool;
+        for(unsigned m = 0; m < PoolSize; ++m)
+          pool->next[m].store(0, std::memory_order_relaxed);
+        _memory[p].store(pool, std::memory_order_release);
+        for(unsigned m = PoolSize; m > 0; --m)
+          _push(p * PoolSize + m - 1);
+        return true;
+      }
+    return false;
+  }
+
+public:
+
+  /**
+    @brief Allocates memory from the pool
+    
+    If there is no free cell another pool is allocated, nullptr is returned when
+    there are MaxPools already.
+    
+    @return Pointer to a free cell of memory in the pool.
+  */
+  void* allocate()
+  {
+    int slot = PoolAllocatorDetail::threadSlot();
+    _enter(slot);
+    void* block = nullptr;
+    if(slot >= 0 && _magazines[slot].count > 0)
+      block = _magazines[slot].cells[--_magazines[slot].count];
+    
+    uint64_t head = _head.load(std::memory_order_acquire);
+    while(block == nullptr)
+    {
+      uint32_t first = (uint32_t)head;
+      if(first == 0)
+      {
+        {
+          std::lock_guard<std::mutex> lock(_reserve_lock);
+          if((uint32_t)_head.load(std::memory_order_acquire) == 0 && !_addPool())
+            break;
+        }
+        head = _head.load(std::memory_order_acquire);
+        continue;
+      }
+      uint32_t next = _link(first - 1).load(std::memory_order_relaxed);
+      if(_head.compare_exchange_weak(head, _makeHead(head, next),
+        std::memory_order_acquire, std::memory_order_acquire))
+      {
+        Pool* pool = _memory[(first - 1) / PoolSize].load(std::memory_order_relaxed);
+        block = (void*)&pool->cells[(first - 1) % PoolSize];
+      }
+    }
+    _leave(slot);
+    return block;
+  }
+
+  /**
+    @brief deallocates memory
+    
+    @param block Pointer to the cell to free. This must point to a cell allocated with
+    the same ConcurrentPoolAllocator objects allocate function.
+  */
+  void deallocate(void* block)
+  {
+    int slot = PoolAllocatorDetail::threadSlot();
+    _enter(slot);
+    assert(owns(block));
+    if(slot >= 0 && _magazines[slot].count < MagazineSize)
+      _magazines[slot].cells[_magazines[slot].count++] = block;
+    else
+      _push(_index(block));
+    _leave(slot);
+  }
+
+  /**
+    @brief Tells whether block points to a cell of this allocator.
+  */
+  bool owns(void* block)
+  {
+    for(auto& pool: _memory)
+    {
+      Pool* p = pool.load(std::memory_order_acquire);
+      if(p != nullptr && block >= (void*)p->cells && block < (void*)(p->cells + PoolSize))
+        return true;
+    }
+    return false;
+  }
+
+  /**
+    @brief Preallocates a number of pools.
+    
+    Safe to call concurrently with itself, clear and allocate/deallocate.
+    
+    @param num_pools Number of pools to preallocate. Default: 1
+  */
+  void reserve(unsigned num_pools = 1)
+  {
+    std::lock_guard<std::mutex> lock(_reserve_lock);
+    for(unsigned p = 0; p < num_pools && _addPool(); ++p);
+  }
+
+  /**
+    @brief Deallocates all pools.
+    
+    Safe to call concurrently with itself, reserve, allocate and deallocate. Calls to
+    allocate and deallocate already running are finished first, the ones made
+    meanwhile wait for clear to return. All pointers to memory in the pool will be
+    invalidated, cells allocated before must not be deallocated after.
+  */
+  void clear()
+  {
+    std::lock_guard<std::mutex> clear_lock(_clear_lock);
+    _clearing.store(true, std::memory_order_relaxed);
+    PoolAllocatorDetail::heavyFence();
+    for(auto& magazine: _magazines)
+      while(magazine.busy.load(std::memory_order_acquire))
+        std::this_thread::yield();
+    while(_busy.load(std::memory_order_acquire) != 0)
+      std::this_thread::yield();
+    {
+      std::lock_guard<std::mutex> lock(_reserve_lock);
+      _head.store(_makeHead(_head.load(std::memory_order_relaxed), 0));
+      for(auto& magazine: _magazines)
+        magazine.count = 0;
+      for(auto& pool: _memory)
+        delete pool.exchange(nullptr);
+    }
+    _clearing.store(false, std::memory_order_release);
+  }
+
+  ConcurrentPoolAllocator(): _head(0), _busy(0), _clearing(false)
+  {
+    for(auto& pool: _memory)
+      pool.store(nullptr, std::memory_order_relaxed);
+    for(auto& magazine: _magazines)
+    {
+      magazine.count = 0;
+      magazine.busy.store(false, std::memory_order_relaxed);
+    }
+  }
+  ConcurrentPoolAllocator(const ConcurrentPoolAllocator&) = delete;
+  void operator=(const ConcurrentPoolAllocator&) = delete;
+  
+  ~ConcurrentPoolAllocator()
+  {
+    this->clear();
+  }
+};
+
+#endif
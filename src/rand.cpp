@@ -13,7 +13,8 @@ constexpr Rand::DeviceType::result_type _div =
 
 namespace
 {
-  std::unordered_map<int, Rand::DeviceType> _devices;
+  //each thread has a set of devices of it's own
+  thread_local std::unordered_map<int, Rand::DeviceType> _devices;
 }
 
 namespace Rand
@@ -35,6 +36,11 @@ namespace Rand
     else _devices[device].seed(seq);
   }
   
+  void clearDevices()
+  {
+    _devices.clear();
+  }
+  
   DeviceType* getDevice(int device)
   {
     auto it = _devices.find(device);
@@ -43,6 +49,17 @@ namespace Rand
     else return &(it->second);
   }
   
+  Philox makePhilox(int device)
+  {
+    auto it = _devices.find(device);
+    if(it == _devices.end())
+      throw tgException("invalid random device");
+    auto& dev = it->second;
+    uint32_t k0 = dev() - DeviceType::min();
+    uint32_t k1 = dev() - DeviceType::min();
+    return Philox(k0, k1);
+  }
+  
   uint32_t getMax(int device)
   {
     return DeviceType::max() - DeviceType::min();
@@ -1,6 +1,7 @@
 #ifndef RAND_H_INCLUDED
 #define RAND_H_INCLUDED
 
+#include <array>
 #include <string>
 #include <random>
 #include <cstdint>
@@ -11,10 +12,59 @@ namespace Rand
 {
   using DeviceType = std::mt19937;
   
+  /*
+    Philox4x32-10 counter based generator (Salmon et al, "Parallel random numbers:
+    as easy as 1, 2, 3"). it maps a 64 bit counter to 4 random values, the mapping
+    depends only on the key, so any range of counters can be generated from any
+    thread in any order.
+  */
+  class Philox
+  {
+    uint32_t _key[2];
+    
+    static void _mulhilo(uint32_t a, uint32_t b, uint32_t& hi, uint32_t& lo)
+    {
+      uint64_t p = (uint64_t)a * b;
+      hi = (uint32_t)(p >> 32);
+      lo = (uint32_t)p;
+    }
+    
+  public:
+    static constexpr uint32_t max()
+    {
+      return 0xffffffff;
+    }
+    
+    std::array<uint32_t, 4> operator()(uint64_t counter) const
+    {
+      uint32_t c[4] = {(uint32_t)counter, (uint32_t)(counter >> 32), 0, 0};
+      uint32_t k0 = _key[0], k1 = _key[1];
+      for(int r = 0; r < 10; ++r)
+      {
+        uint32_t hi0, lo0, hi1, lo1;
+        _mulhilo(0xd2511f53, c[0], hi0, lo0);
+        _mulhilo(0xcd9e8d57, c[2], hi1, lo1);
+        c[0] = hi1 ^ c[1] ^ k0;
+        c[1] = lo1;
+        c[2] = hi0 ^ c[3] ^ k1;
+        c[3] = lo0;
+        k0 += 0x9e3779b9;
+        k1 += 0xbb67ae85;
+      }
+      return {{c[0], c[1], c[2], c[3]}};
+    }
+    
+    Philox(uint32_t k0, uint32_t k1): _key{k0, k1}{}
+  };
+  
+  //devices belong to the calling thread
   void seedDevice(int, int);
   void seedDevice(int, std::string);
+  void clearDevices();
   
   DeviceType* getDevice(int);
+  //a generator keyed with the next two values of the device
+  Philox makePhilox(int);
   uint32_t getMax(int);
   std::vector<uint32_t> producei(int, int);
   std::vector<std::pair<uint32_t, uint32_t>> produceip(int, int);
@@ -0,0 +1,310 @@
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <sys/stat.h>
+
+#include "common.h"
+
+#include "result_cache.h"
+
+namespace
+{
+  constexpr uint64_t _c1 = 0x87c37b91114253d5ull;
+  constexpr uint64_t _c2 = 0x4cf5ad432745937full;
+
+  inline uint64_t _rotl(uint64_t x, int r)
+  {
+    return (x << r) | (x >> (64 - r));
+  }
+
+  inline uint64_t _fmix(uint64_t k)
+  {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdull;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ull;
+    k ^= k >> 33;
+    return k;
+  }
+
+  inline uint64_t _mixK1(uint64_t k1)
+  {
+    k1 *= _c1;
+    k1 = _rotl(k1, 31);
+    return k1 * _c2;
+  }
+
+  inline uint64_t _mixK2(uint64_t k2)
+  {
+    k2 *= _c2;
+    k2 = _rotl(k2, 33);
+    return k2 * _c1;
+  }
+
+  constexpr size_t _memory_limit = 256 << 20;
+  constexpr char _magic[4] = {'T', 'G', 'R', 'C'};
+
+  //entries are shared, so a texture in use outside the lock is never deleted
+  struct _Entry
+  {
+    ResultCache::Key key;
+    std::shared_ptr<Texture> tex;
+  };
+
+  std::mutex _lock;
+  bool _enabled = false;
+  std::string _dir;
+  //most recently used first
+  std::list<_Entry> _entries;
+  size_t _size = 0;
+  std::atomic<unsigned> _tmp_counter(0);
+
+  size_t _bytes(const Texture* tex)
+  {
+    return sizeof(Eigen::Array4f) * tex->width * tex->height;
+  }
+
+  std::shared_ptr<Texture> _share(Texture* tex)
+  {
+    return std::shared_ptr<Texture>(tex, [](Texture* t){deleteTexture(t);});
+  }
+
+  void _insertMemory(const ResultCache::Key& key, const std::shared_ptr<Texture>& tex)
+  {
+    size_t bytes = _bytes(tex.get());
+    if(bytes > _memory_limit)
+      return;
+    for(auto& entry: _entries)
+      if(entry.key == key)
+        return;
+    while(_size + bytes > _memory_limit)
+    {
+      _size -= _bytes(_entries.back().tex.get());
+      _entries.pop_back();
+    }
+    _entries.push_front({key, tex});
+    _size += bytes;
+  }
+
+  void _clearMemory()
+  {
+    _entries.clear();
+    _size = 0;
+  }
+
+  std::string _fileName(const std::string& dir, const ResultCache::Key& key)
+  {
+    char name[40];
+    snprintf(name, 40, "%016llx%016llx.tex",
+      (unsigned long long)key.h1, (unsigned long long)key.h2);
+    return dir + "/" + name;
+  }
+
+  //interleaved texels only
+  Texture* _readFile(const std::string& filename)
+  {
+    FILE* file = fopen(filename.c_str(), "rb");
+    if(file == nullptr)
+      return nullptr;
+
+    char magic[4];
+    uint32_t dims[2];
+    Texture* tex = nullptr;
+    try
+    {
+      if(fread(magic, 4, 1, file) == 1 && memcmp(magic, _magic, 4) == 0 &&
+        fread(dims, sizeof(dims), 1, file) == 1 && dims[0] > 0 && dims[1] > 0)
+      {
+        tex = makeTexture(dims[0], dims[1]);
+        if(fread(tex->data(), _bytes(tex), 1, file) != 1)
+        {
+          deleteTexture(tex);
+          tex = nullptr;
+        }
+      }
+    }
+    //a file too large for the texture memory is made again by the caller
+    catch(std::exception&){}
+    fclose(file);
+    return tex;
+  }
+
+  //written to a temporary file first, so other processes never read a partial file
+  void _writeFile(const std::string& filename, const Texture* tex)
+  {
+    std::string tmp_name = filename + "." +
+      std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) +
+      "." + std::to_string(_tmp_counter++);
+    FILE* file = fopen(tmp_name.c_str(), "wb");
+    if(file == nullptr)
+      return;
+
+    uint32_t dims[2] = {tex->width, tex->height};
+    bool written =
+      fwrite(_magic, 4, 1, file) == 1 &&
+      fwrite(dims, sizeof(dims), 1, file) == 1 &&
+      fwrite(tex->data(), _bytes(tex), 1, file) == 1;
+    written = fclose(file) == 0 && written;
+
+    if(!written || std::rename(tmp_name.c_str(), filename.c_str()) != 0)
+      std::remove(tmp_name.c_str());
+  }
+}
+
+namespace ResultCache
+{
+  void Hasher::_block(const uint8_t* data)
+  {
+    uint64_t k1, k2;
+    memcpy(&k1, data, 8);
+    memcpy(&k2, data + 8, 8);
+
+    _h1 ^= _mixK1(k1);
+    _h1 = _rotl(_h1, 27);
+    _h1 += _h2;
+    _h1 = _h1 * 5 + 0x52dce729;
+
+    _h2 ^= _mixK2(k2);
+    _h2 = _rotl(_h2, 31);
+    _h2 += _h1;
+    _h2 = _h2 * 5 + 0x38495ab5;
+  }
+
+  void Hasher::add(const void* ptr, size_t size)
+  {
+    const uint8_t* data = (const uint8_t*)ptr;
+    _length += size;
+
+    if(_tail_size > 0)
+    {
+      size_t fill = 16 - _tail_size;
+      if(size < fill)
+      {
+        memcpy(_tail + _tail_size, data, size);
+        _tail_size += size;
+        return;
+      }
+      memcpy(_tail + _tail_size, data, fill);
+      _block(_tail);
+      data += fill;
+      size -= fill;
+      _tail_size = 0;
+    }
+
+    for(; size >= 16; data += 16, size -= 16)
+      _block(data);
+
+    memcpy(_tail, data, size);
+    _tail_size = size;
+  }
+
+  void Hasher::add(const Texture* tex)
+  {
+    *this << tex->width << tex->height << tex->layout;
+    add(tex->data(), _bytes(tex));
+  }
+
+  Key Hasher::key() const
+  {
+    uint64_t h1 = _h1, h2 = _h2;
+    uint64_t k1 = 0, k2 = 0;
+    for(int i = _tail_size - 1; i >= 8; --i)
+      k2 = (k2 << 8) | _tail[i];
+    for(int i = (_tail_size < 8? _tail_size : 8) - 1; i >= 0; --i)
+      k1 = (k1 << 8) | _tail[i];
+    if(_tail_size > 8)
+      h2 ^= _mixK2(k2);
+    if(_tail_size > 0)
+      h1 ^= _mixK1(k1);
+
+    h1 ^= _length;
+    h2 ^= _length;
+    h1 += h2;
+    h2 += h1;
+    h1 = _fmix(h1);
+    h2 = _fmix(h2);
+    h1 += h2;
+    h2 += h1;
+    return {h1, h2};
+  }
+
+  Hasher::Hasher(const char* op): _h1(0), _h2(0), _tail_size(0), _length(0)
+  {
+    add(op, strlen(op) + 1);
+  }
+
+  void enable(const std::string& dir)
+  {
+    if(!dir.empty() && mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST)
+      throw tgException("unable to create directory \'%s\'", dir.c_str());
+    std::lock_guard<std::mutex> lock(_lock);
+    _enabled = true;
+    _dir = dir;
+  }
+
+  void disable()
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    _enabled = false;
+    _dir.clear();
+    _clearMemory();
+  }
+
+  bool enabled()
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    return _enabled;
+  }
+
+  std::shared_ptr<Texture> find(const Key& key)
+  {
+    std::string dir;
+    std::shared_ptr<Texture> hit;
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      for(auto it = _entries.begin(); it != _entries.end(); ++it)
+        if(it->key == key)
+        {
+          _entries.splice(_entries.begin(), _entries, it);
+          hit = it->tex;
+          break;
+        }
+      dir = _dir;
+    }
+    if(hit || dir.empty())
+      return hit;
+
+    Texture* tex = _readFile(_fileName(dir, key));
+    if(tex == nullptr)
+      return nullptr;
+    hit = _share(tex);
+    std::lock_guard<std::mutex> lock(_lock);
+    _insertMemory(key, hit);
+    return hit;
+  }
+
+  std::shared_ptr<Texture> insert(const Key& key, Texture* tex)
+  {
+    assert(!tex->packed && !tex->planar());
+    std::shared_ptr<Texture> shared = _share(tex);
+    std::string dir;
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      if(!_enabled)
+        return shared;
+      _insertMemory(key, shared);
+      dir = _dir;
+    }
+    if(!dir.empty())
+      _writeFile(_fileName(dir, key), tex);
+    return shared;
+  }
+}
@@ -0,0 +1,82 @@
+#ifndef RESULT_CACHE_H_INCLUDED
+#define RESULT_CACHE_H_INCLUDED
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "texture.h"
+
+/*
+  results of expensive deterministic operations, keyed by a 128 bit hash of the
+  name of the operation, it's parameters and the contents of the input textures.
+  random input enters through the parameters (point sets, generator keys), so
+  equal keys mean equal results across runs.
+
+  results are kept in memory, least recently used first out past a limit, and
+  written to a directory if one is set, so a later run finds them there.
+  results are shared with the callers as they are, so they must never be changed,
+  a caller about to change one makes a copy of it's own first.
+  all functions are thread safe.
+*/
+namespace ResultCache
+{
+  struct Key
+  {
+    uint64_t h1, h2;
+
+    bool operator==(const Key& other) const
+    {
+      return h1 == other.h1 && h2 == other.h2;
+    }
+  };
+
+  //MurmurHash3 x64 128, fed incrementally
+  class Hasher
+  {
+    uint64_t _h1, _h2;
+    uint8_t _tail[16];
+    int _tail_size;
+    uint64_t _length;
+
+    void _block(const uint8_t*);
+
+  public:
+    void add(const void*, size_t);
+    //the dimensions and texels of an unpacked texture
+    void add(const Texture*);
+
+    template<class T>
+    Hasher& operator<<(const T& value)
+    {
+      add(&value, sizeof(value));
+      return *this;
+    }
+    template<class T>
+    Hasher& operator<<(const std::vector<T>& values)
+    {
+      *this << values.size();
+      add(values.data(), values.size() * sizeof(T));
+      return *this;
+    }
+
+    Key key() const;
+
+    //the name of the operation starts the key
+    explicit Hasher(const char*);
+  };
+
+  //enables the cache, results are stored in dir as well unless it's empty
+  void enable(const std::string&);
+  void disable();
+  bool enabled();
+
+  //the result, or nullptr
+  std::shared_ptr<Texture> find(const Key&);
+  //takes over an unpacked, interleaved texture and returns the handle to it
+  std::shared_ptr<Texture> insert(const Key&, Texture*);
+}
+
+#endif
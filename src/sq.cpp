@@ -20,7 +20,7 @@
 
 namespace
 {
-  bool _inited = false;
+  thread_local bool _inited = false;
 
   void _squPrint(HSQUIRRELVM v, const char* text, ...)
   {
@@ -60,12 +60,12 @@ namespace
     Terminal::printfm("%s", buffer.get());
   }
   
-  std::set<uint32_t> _executed_nuts;
+  thread_local std::set<uint32_t> _executed_nuts;
 }
 
 namespace Sq
 {
-  HSQUIRRELVM vm;
+  thread_local HSQUIRRELVM vm;
   bool reload = false;
   
   bool executeNut(const char* filename, bool reload)
@@ -126,7 +126,6 @@ namespace Sq
   
   void reloadVM()
   {
-    _executed_nuts.clear();
     deinit();
     init();
     Terminal::updateSymbols();
@@ -172,5 +171,7 @@ namespace Sq
       return;
     sq_settop(vm, 0);
     sq_close(vm);
+    _executed_nuts.clear();
+    _inited = false;
   }
 }
\ No newline at end of file
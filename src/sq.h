@@ -11,7 +11,8 @@
 
 namespace Sq
 {
-  extern HSQUIRRELVM vm;
+  //each thread has a vm of it's own, made by init
+  extern thread_local HSQUIRRELVM vm;
   extern bool reload;
   
   //these are all throwing functions
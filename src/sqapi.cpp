@@ -2,8 +2,10 @@
 #include "common.h"
 #include "h3d.h"
 #include "texture_manager.h"
+#include "tex_op.h"
 #include "rand.h"
 #include "point_set.h"
+#include "result_cache.h"
 #include "terminal.h"
 
 #include "sqapi.h"
@@ -120,6 +122,28 @@ namespace
     return false;
   }
   
+  //reads the optional blur mode after the other arguments of the blur functions,
+  //returns the index of the last other argument, or -1 if the mode is malformed
+  inline int _getBlurMode(HSQUIRRELVM vm, bool& box)
+  {
+    int top = sq_gettop(vm);
+    box = false;
+    if(sq_gettype(vm, top) == OT_STRING)
+    {
+      const SQChar* mode;
+      sq_getstring(vm, top, &mode);
+      if(strcmp(mode, "box") == 0)
+        box = true;
+      else if(strcmp(mode, "binomial") != 0)
+        return -1;
+      --top;
+    }
+    for(int i = 4; i <= top; ++i)
+      if(sq_gettype(vm, i) == OT_STRING)
+        return -1;
+    return top;
+  }
+  
   inline std::vector<std::pair<double, double>>
     _extractPointSet(HSQUIRRELVM vm, int idx)
   {
@@ -234,6 +258,21 @@ namespace
     return 1;
   }
   
+  SQInteger setScheduling(HSQUIRRELVM vm)
+  {
+    const SQChar* mode;
+    sq_getstring(vm, 2, &mode);
+    
+    if(strcmp(mode, "static") == 0)
+      TexOp::setScheduling(TexOp::Scheduling::Static);
+    else if(strcmp(mode, "dynamic") == 0)
+      TexOp::setScheduling(TexOp::Scheduling::Dynamic);
+    else return sq_throwerror(vm,
+      _SC("malformed argument 1 in setScheduling; expected 'static' or 'dynamic'"));
+    
+    return 0;
+  }
+  
   //viewer control
   SQInteger loadPipeline(HSQUIRRELVM vm)
   {
@@ -589,14 +628,40 @@ namespace
     sq_getinteger(vm, 2, &width);
     sq_getinteger(vm, 3, &height);
     
-    if(width < 0x10 || width > 0x1000 ||
-      height < 0x10 || height > 0x1000 ||
+    if(width < 0x10 || width > 0x4000 ||
+      height < 0x10 || height > 0x4000 ||
       (width & (width - 1)) != 0 ||
       (height & (height - 1)) != 0)
       return sq_throwerror(vm,
-        _SC("texture dimensions must be powers of 2 in interval 16..4096"));
+        _SC("texture dimensions must be powers of 2 in interval 16..16384"));
     
-    SQInteger tex = TextureManager::addTexture(width, height);
+    TexHeader::Format format = TexHeader::Format::Float;
+    if(sq_gettop(vm) == 4)
+    {
+      const SQChar* format_str;
+      sq_getstring(vm, 4, &format_str);
+      if(strcmp(format_str, "float") == 0)
+        format = TexHeader::Format::Float;
+      else if(strcmp(format_str, "half") == 0)
+        format = TexHeader::Format::Half;
+      else if(strcmp(format_str, "unorm16") == 0)
+        format = TexHeader::Format::Unorm16;
+      else if(strcmp(format_str, "unorm8") == 0)
+        format = TexHeader::Format::Unorm8;
+      else return sq_throwerror(vm, _SC("malformed argument 3 in createTexture; "
+        "expected 'float', 'half', 'unorm16' or 'unorm8'"));
+    }
+    
+    SQInteger tex;
+    try
+    {
+      tex = TextureManager::addTexture(width, height, format);
+    }
+    catch(std::exception& e)
+    {
+      std::string error_str = std::string("createTexture: ") + e.what();
+      return sq_throwerror(vm, error_str.c_str());
+    }
     sq_pushinteger(vm, tex);
     return 1;
   }
@@ -620,7 +685,16 @@ namespace
   
   SQInteger listTextures(HSQUIRRELVM vm)
   {
-    std::vector<int> textures = TextureManager::listTextures();
+    std::vector<int> textures;
+    try
+    {
+      textures = TextureManager::listTextures();
+    }
+    catch(std::exception& e)
+    {
+      std::string error_str = std::string("listTextures: ") + e.what();
+      return sq_throwerror(vm, error_str.c_str());
+    }
     
     sq_newarray(vm, 0);
     for(int tex: textures)
@@ -656,37 +730,45 @@ namespace
     
     std::sort(textures.begin(), textures.end());
     
-    if(keep == SQTrue)
+    try
     {
-      std::vector<int> all_textures = TextureManager::listTextures();
-      auto it1 = all_textures.begin();
-      auto it2 = textures.begin();
-      for(;;)
+      if(keep == SQTrue)
       {
-        if(*it1 < *it2)
+        std::vector<int> all_textures = TextureManager::listTextures();
+        auto it1 = all_textures.begin();
+        auto it2 = textures.begin();
+        for(;;)
         {
-          ++it1;
-          if(it1 == all_textures.end()) break;
-        }
-        else if(*it1 > *it2)
-        {
-          ++it2;
-          if(it2 == textures.end()) break;
-        }
-        else
-        {
-          *it1 = -1;
-          ++it1;
-          ++it2;
-          if(it1 == all_textures.end()) break;
-          if(it2 == textures.end()) break;
+          if(*it1 < *it2)
+          {
+            ++it1;
+            if(it1 == all_textures.end()) break;
+          }
+          else if(*it1 > *it2)
+          {
+            ++it2;
+            if(it2 == textures.end()) break;
+          }
+          else
+          {
+            *it1 = -1;
+            ++it1;
+            ++it2;
+            if(it1 == all_textures.end()) break;
+            if(it2 == textures.end()) break;
+          }
         }
+        all_textures.erase(std::remove(all_textures.begin(), all_textures.end(), -1),
+          all_textures.end());
+        textures = std::move(all_textures);
       }
-      all_textures.erase(std::remove(all_textures.begin(), all_textures.end(), -1),
-        all_textures.end());
-      textures = std::move(all_textures);
+      TextureManager::destroyTextures(textures.begin(), textures.end());
+    }
+    catch(std::exception& e)
+    {
+      std::string error_str = std::string("destroyTextures: ") + e.what();
+      return sq_throwerror(vm, error_str.c_str());
     }
-    TextureManager::destroyTextures(textures.begin(), textures.end());
     
     return 0;
   }
@@ -772,16 +854,31 @@ namespace
     sq_getinteger(vm, 3, &width);
     sq_getinteger(vm, 4, &height);
     
-    if(width < 0x10 || width > 0x1000 ||
-      height < 0x10 || height > 0x1000 ||
-      (width & (width - 1)) != 0 ||
-      (height & (height - 1)) != 0)
+    if(width < 0x10 || width > 0x4000 ||
+      height < 0x10 || height > 0x4000)
       return sq_throwerror(vm,
-        _SC("texture dimensions must be powers of 2 in interval 16..4096"));
+        _SC("texture dimensions must be in interval 16..16384"));
+    
+    TexOp::ResizeFilter filter = TexOp::ResizeFilter::Bilinear;
+    if(sq_gettop(vm) == 5)
+    {
+      const SQChar* filter_str;
+      sq_getstring(vm, 5, &filter_str);
+      if(strcmp(filter_str, "box") == 0)
+        filter = TexOp::ResizeFilter::Box;
+      else if(strcmp(filter_str, "bilinear") == 0)
+        filter = TexOp::ResizeFilter::Bilinear;
+      else if(strcmp(filter_str, "bicubic") == 0)
+        filter = TexOp::ResizeFilter::Bicubic;
+      else if(strcmp(filter_str, "lanczos") == 0)
+        filter = TexOp::ResizeFilter::Lanczos;
+      else return sq_throwerror(vm, _SC("malformed argument 4 in resizeTexture; "
+        "expected 'box', 'bilinear', 'bicubic' or 'lanczos'"));
+    }
     
     try
     {
-      TextureManager::resizeTexture(tex, width, height);
+      TextureManager::resizeTexture(tex, width, height, filter);
     }
     catch(std::exception& e)
     {
@@ -791,6 +888,34 @@ namespace
     return 0;
   }
   
+  SQInteger setTextureLayout(HSQUIRRELVM vm)
+  {
+    SQInteger tex;
+    const SQChar* layout_str;
+    TexHeader::Layout layout;
+    
+    sq_getinteger(vm, 2, &tex);
+    sq_getstring(vm, 3, &layout_str);
+    
+    if(strcmp(layout_str, "interleaved") == 0)
+      layout = TexHeader::Layout::Interleaved;
+    else if(strcmp(layout_str, "planar") == 0)
+      layout = TexHeader::Layout::Planar;
+    else return sq_throwerror(vm, _SC(
+      "malformed argument 2 in setTextureLayout; expected 'interleaved' or 'planar'"));
+    
+    try
+    {
+      TextureManager::setTextureLayout(tex, layout);
+    }
+    catch(std::exception& e)
+    {
+      std::string error_str = std::string("setTextureLayout: ") + e.what();
+      return sq_throwerror(vm, error_str.c_str());
+    }
+    return 0;
+  }
+  
   SQInteger getTextureDimensions(HSQUIRRELVM vm)
   {
     SQInteger tex;
@@ -816,6 +941,182 @@ namespace
     return 1;
   }
   
+  SQInteger setDeferred(HSQUIRRELVM vm)
+  {
+    SQBool deferred;
+    sq_getbool(vm, 2, &deferred);
+    
+    try
+    {
+      TextureManager::setDeferred(deferred);
+    }
+    catch(std::exception& e)
+    {
+      std::string error_str = std::string("setDeferred: ") + e.what();
+      return sq_throwerror(vm, error_str.c_str());
+    }
+    return 0;
+  }
+  
+  SQInteger setAsync(HSQUIRRELVM vm)
+  {
+    SQBool async;
+    sq_getbool(vm, 2, &async);
+    
+    try
+    {
+      TextureManager::setAsync(async);
+    }
+    catch(std::exception& e)
+    {
+      std::string error_str = std::string("setAsync: ") + e.what();
+      return sq_throwerror(vm, error_str.c_str());
+    }
+    return 0;
+  }
+  
+  //true or false, or the directory the results are stored in
+  SQInteger setResultCache(HSQUIRRELVM vm)
+  {
+    try
+    {
+      if(sq_gettype(vm, 2) == OT_STRING)
+      {
+        const SQChar* dir;
+        sq_getstring(vm, 2, &dir);
+        ResultCache::enable(dir);
+      }
+      else
+      {
+        SQBool enable;
+        sq_getbool(vm, 2, &enable);
+        if(enable)
+          ResultCache::enable("");
+        else
+          ResultCache::disable();
+      }
+    }
+    catch(std::exception& e)
+    {
+      std::string error_str = std::string("setResultCache: ") + e.what();
+      return sq_throwerror(vm, error_str.c_str());
+    }
+    return 0;
+  }
+  
+  SQInteger getMemoryStats(HSQUIRRELVM vm)
+  {
+    TexArena::Stats stats;
+    try
+    {
+      stats = TextureManager::getMemoryStats();
+    }
+    catch(std::exception& e)
+    {
+      std::string error_str = std::string("getMemoryStats: ") + e.what();
+      return sq_throwerror(vm, error_str.c_str());
+    }
+    std::pair<const SQChar*, size_t> fields[] = {
+      {_SC("requested"), stats.requested},
+      {_SC("used"), stats.used},
+      {_SC("idle"), stats.idle},
+      {_SC("reserved"), stats.reserved},
+      {_SC("peak"), stats.peak},
+      {_SC("limit"), stats.limit},
+      {_SC("allocations"), stats.allocations},
+      {_SC("scratch"), stats.scratch}};
+    
+    sq_newtable(vm);
+    for(auto& field: fields)
+    {
+      sq_pushstring(vm, field.first, -1);
+      sq_pushinteger(vm, field.second);
+      sq_newslot(vm, -3, SQFalse);
+    }
+    return 1;
+  }
+  
+  //the limit is in MB, 0 for none
+  SQInteger setMemoryLimit(HSQUIRRELVM vm)
+  {
+    SQInteger limit;
+    sq_getinteger(vm, 2, &limit);
+    if(limit < 0)
+      return sq_throwerror(vm, _SC("malformed argument 1 in setMemoryLimit"));
+    try
+    {
+      TextureManager::setMemoryLimit((size_t)limit << 20);
+    }
+    catch(std::exception& e)
+    {
+      std::string error_str = std::string("setMemoryLimit: ") + e.what();
+      return sq_throwerror(vm, error_str.c_str());
+    }
+    return 0;
+  }
+  
+  SQInteger trimMemory(HSQUIRRELVM vm)
+  {
+    try
+    {
+      TextureManager::trimMemory();
+    }
+    catch(std::exception& e)
+    {
+      std::string error_str = std::string("trimMemory: ") + e.what();
+      return sq_throwerror(vm, error_str.c_str());
+    }
+    return 0;
+  }
+  
+  SQInteger setHugePages(HSQUIRRELVM vm)
+  {
+    SQBool huge_pages;
+    sq_getbool(vm, 2, &huge_pages);
+    try
+    {
+      TextureManager::setHugePages(huge_pages);
+    }
+    catch(std::exception& e)
+    {
+      std::string error_str = std::string("setHugePages: ") + e.what();
+      return sq_throwerror(vm, error_str.c_str());
+    }
+    return 0;
+  }
+  
+  //an empty string for none
+  SQInteger setScratchDir(HSQUIRRELVM vm)
+  {
+    const SQChar* dir;
+    sq_getstring(vm, 2, &dir);
+    
+    try
+    {
+      TextureManager::setScratchDir(dir);
+    }
+    catch(std::exception& e)
+    {
+      std::string error_str = std::string("setScratchDir: ") + e.what();
+      return sq_throwerror(vm, error_str.c_str());
+    }
+    return 0;
+  }
+  
+  SQInteger flushTextures(HSQUIRRELVM vm)
+  {
+    try
+    {
+      TextureManager::flushTextures();
+    }
+    catch(std::exception& e)
+    {
+      std::string error_str = std::string("flushTextures: ") + e.what();
+      return sq_throwerror(vm, error_str.c_str());
+    }
+    return 0;
+  }
+  
   //blobs
   template<class T>
   SQInteger writeTexture(HSQUIRRELVM vm)
@@ -1546,6 +1847,7 @@ namespace
   {
     SQInteger tex, mask;
     SQFloat f;
+    bool box;
     std::array<int, 2> dims;
     
     sq_getinteger(vm, 2, &tex);
@@ -1555,7 +1857,11 @@ namespace
     if(dims[0] < 0 || dims[1] < 0)
       return sq_throwerror(vm, _SC("malformed argument 2 in clearTexture"));
       
-    switch(sq_gettop(vm))
+    int top = _getBlurMode(vm, box);
+    if(top < 0) return sq_throwerror(vm,
+      _SC("malformed blur mode in blurTexture; expected 'binomial' or 'box'"));
+    
+    switch(top)
     {
     case 3:
       f = 1.;
@@ -1587,7 +1893,7 @@ namespace
     SQInteger ret;
     try
     {
-      ret = TextureManager::blurTexture(tex, dims[0], dims[1], f, mask);
+      ret = TextureManager::blurTexture(tex, dims[0], dims[1], f, mask, box);
     }
     catch(std::exception& e)
     {
@@ -1603,6 +1909,7 @@ namespace
   {
     SQInteger tex, mask;
     SQFloat f;
+    bool box;
     std::array<int, 2> dims;
     
     sq_getinteger(vm, 2, &tex);
@@ -1612,7 +1919,11 @@ namespace
     if(dims[0] < 0 || dims[1] < 0)
       return sq_throwerror(vm, _SC("malformed argument 2 in clearTexture"));
       
-    switch(sq_gettop(vm))
+    int top = _getBlurMode(vm, box);
+    if(top < 0) return sq_throwerror(vm,
+      _SC("malformed blur mode in blurInplace; expected 'binomial' or 'box'"));
+    
+    switch(top)
     {
     case 3:
       f= 1.;
@@ -1643,7 +1954,7 @@ namespace
     
     try
     {
-      TextureManager::blurInplace(tex, dims[0], dims[1], f, mask);
+      TextureManager::blurInplace(tex, dims[0], dims[1], f, mask, box);
     }
     catch(std::exception& e)
     {
@@ -2211,6 +2522,25 @@ namespace
     return 0;
   }
   
+  //textures with a reduced precision format are packed again after every call
+  template<SQFUNCTION F>
+  SQInteger _packAfter(HSQUIRRELVM vm)
+  {
+    SQInteger ret = F(vm);
+    if(ret < 0)
+      return ret;
+    try
+    {
+      TextureManager::packTextures();
+    }
+    catch(std::exception& e)
+    {
+      std::string error_str = std::string("packTextures: ") + e.what();
+      return sq_throwerror(vm, error_str.c_str());
+    }
+    return ret;
+  }
+  
   //reloading vm
   SQInteger reloadVM(HSQUIRRELVM vm)
   {
@@ -2230,12 +2560,12 @@ namespace SqAPI
     
     #define NEW_CLOSURE(name, args, types) \
       sq_pushstring(vm, _SC(#name), -1); \
-      sq_newclosure(vm, name, 0); \
+      sq_newclosure(vm, _packAfter<name>, 0); \
       sq_setparamscheck(vm, args, types); \
       sq_newslot(vm, -3, SQFalse);
     #define NEW_CLOSURE_N(name, func, args, types) \
       sq_pushstring(vm, _SC(#name), -1); \
-      sq_newclosure(vm, func, 0); \
+      sq_newclosure(vm, _packAfter<func>, 0); \
       sq_setparamscheck(vm, args, types); \
       sq_newslot(vm, -3, SQFalse);
     
@@ -2248,6 +2578,7 @@ namespace SqAPI
     
     NEW_CLOSURE(loadNut, 2, "ts")
     NEW_CLOSURE(reloadNut, 2, "ts")
+    NEW_CLOSURE(setScheduling, 2, "ts")
     NEW_CLOSURE(loadPipeline, 2, "ts")
     NEW_CLOSURE(setPipeline, 2, "t.")
     NEW_CLOSURE(loadModel, 2, "ts")
@@ -2261,13 +2592,23 @@ namespace SqAPI
     NEW_CLOSURE(enableRenderStage, 2, "ts")
     NEW_CLOSURE(disableRenderStage, 2, "ts")
     NEW_CLOSURE(loadTexture, 2, "t.")
-    NEW_CLOSURE(createTexture, 3, "tii")
+    NEW_CLOSURE(createTexture, -3, "tiis")
     NEW_CLOSURE(destroyTexture, 2, "ti")
     NEW_CLOSURE(cloneTexture, 2, "ti")
     NEW_CLOSURE(copyTexture, -3, "tiii")
     NEW_CLOSURE(swapTextures, -3, "tiii")
-    NEW_CLOSURE(resizeTexture, 4, "tiii")
+    NEW_CLOSURE(resizeTexture, -4, "tiiis")
+    NEW_CLOSURE(setTextureLayout, 3, "tis")
     NEW_CLOSURE(getTextureDimensions, 2, "ti")
+    NEW_CLOSURE(flushTextures, 1, "t")
+    NEW_CLOSURE(setDeferred, 2, "tb")
+    NEW_CLOSURE(setAsync, 2, "tb")
+    NEW_CLOSURE(setResultCache, 2, "tb|s")
+    NEW_CLOSURE(getMemoryStats, 1, "t")
+    NEW_CLOSURE(setMemoryLimit, 2, "ti")
+    NEW_CLOSURE(trimMemory, 1, "t")
+    NEW_CLOSURE(setHugePages, 2, "tb")
+    NEW_CLOSURE(setScratchDir, 2, "ts")
     NEW_CLOSURE(bindSampler, 3, "tsi")
     NEW_CLOSURE(unbindSampler, 2, "ts")
     NEW_CLOSURE(listTextures, 1, "t")
@@ -2303,8 +2644,8 @@ namespace SqAPI
     NEW_CLOSURE(shiftInplace, 4, "tiff")
     NEW_CLOSURE(applyLens, 3, "tii")
     NEW_CLOSURE(applyLensInplace, 3, "tii")
-    NEW_CLOSURE(blurTexture, -3, "tiaf|ii");
-    NEW_CLOSURE(blurInplace, -3, "tiaf|ii");
+    NEW_CLOSURE(blurTexture, -3, "tiaf|i|si|ss");
+    NEW_CLOSURE(blurInplace, -3, "tiaf|i|si|ss");
     NEW_CLOSURE(seedRandomDevice, 3, "tis|i");
     NEW_CLOSURE(generateNoise, -3, "tiii");
     NEW_CLOSURE(generateWhiteNoise, -3, "tiii");
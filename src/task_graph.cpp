@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <new>
+#include <type_traits>
+
+#include "pool_allocator.h"
+
+#include "task_graph.h"
+
+namespace
+{
+  //number of tasks the current thread is executing, tasks nest when a task waits
+  //on the pool
+  thread_local int _tl_task_depth = 0;
+
+  /*
+    nodes are made for every task, by the threads adding them, and the last
+    reference may go on a worker. they come from a pool shared by all graphs,
+    which is never deleted, as graphs may outlive any other static object.
+  */
+  constexpr unsigned _node_size = 128;
+  typedef ConcurrentPoolAllocator<_node_size, 256> _NodePool;
+
+  _NodePool& _nodePool()
+  {
+    static std::aligned_storage<sizeof(_NodePool), alignof(_NodePool)>::type memory;
+    static _NodePool* pool = new(&memory) _NodePool;
+    return *pool;
+  }
+
+  template<class T>
+  struct _NodeAllocator
+  {
+    typedef T value_type;
+
+    _NodeAllocator(){}
+    template<class U>
+    _NodeAllocator(const _NodeAllocator<U>&){}
+
+    //larger allocations, and those past the pools, are left to operator new
+    T* allocate(size_t n)
+    {
+      void* ptr = sizeof(T) * n <= _node_size? _nodePool().allocate() : nullptr;
+      return (T*)(ptr != nullptr? ptr : ::operator new(sizeof(T) * n));
+    }
+    void deallocate(T* ptr, size_t)
+    {
+      if(_nodePool().owns(ptr))
+        _nodePool().deallocate(ptr);
+      else
+        ::operator delete(ptr);
+    }
+
+    template<class U>
+    bool operator==(const _NodeAllocator<U>&) const {return true;}
+    template<class U>
+    bool operator!=(const _NodeAllocator<U>&) const {return false;}
+  };
+}
+
+bool TaskGraph::inTask()
+{
+  return _tl_task_depth > 0;
+}
+
+void TaskGraph::_run(void* ctx, int, int)
+{
+  _Node* node = (_Node*)ctx;
+  TaskGraph* graph = node->graph;
+
+  ++_tl_task_depth;
+  try
+  {
+    node->func();
+  }
+  catch(...)
+  {
+    std::lock_guard<std::mutex> lock(graph->_lock);
+    if(!graph->_error)
+      graph->_error = std::current_exception();
+  }
+  --_tl_task_depth;
+
+  std::vector<_NodePtr> ready;
+  {
+    std::lock_guard<std::mutex> lock(graph->_lock);
+    node->func = nullptr;
+    node->finished.store(true, std::memory_order_release);
+    for(auto& dep: node->dependents)
+      if(--dep->deps == 0)
+        ready.push_back(dep);
+    node->dependents.clear();
+  }
+  for(auto& dep: ready)
+    graph->_pool.submit(&dep->batch, 0, 1, 1);
+}
+
+//releases the tasks which are finished, and which the pool is done with
+void TaskGraph::_prune()
+{
+  auto released = [](const _NodePtr& node)
+  {
+    return node->finished.load(std::memory_order_acquire) && node->batch.done();
+  };
+
+  std::lock_guard<std::mutex> lock(_lock);
+  _nodes.erase(std::remove_if(_nodes.begin(), _nodes.end(), released), _nodes.end());
+  for(auto it = _last.begin(); it != _last.end();)
+  {
+    if(released(it->second))
+      it = _last.erase(it);
+    else
+      ++it;
+  }
+}
+
+void TaskGraph::_waitFor(std::vector<_NodePtr>& nodes)
+{
+  _pool.waitUntil([&nodes]()
+  {
+    for(auto& node: nodes)
+      if(!node->finished.load(std::memory_order_acquire) || !node->batch.done())
+        return false;
+    return true;
+  });
+  nodes.clear();
+  _prune();
+
+  std::exception_ptr error;
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    std::swap(error, _error);
+  }
+  if(error)
+    std::rethrow_exception(error);
+}
+
+void TaskGraph::add(std::function<void()> func, const std::vector<int>& resources)
+{
+  _prune();
+
+  _NodePtr node = std::allocate_shared<_Node>(
+    _NodeAllocator<_Node>(), this, std::move(func));
+  bool ready;
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    for(int res: resources)
+    {
+      _NodePtr& last = _last[res];
+      //resources sharing their last task add one dependency
+      if(last && last != node && !last->finished.load(std::memory_order_relaxed) &&
+        (last->dependents.empty() || last->dependents.back() != node))
+      {
+        last->dependents.push_back(node);
+        ++node->deps;
+      }
+      last = node;
+    }
+    _nodes.push_back(node);
+    ready = node->deps == 0;
+  }
+  if(ready)
+    _pool.submit(&node->batch, 0, 1, 1);
+}
+
+bool TaskGraph::busy(int res)
+{
+  std::lock_guard<std::mutex> lock(_lock);
+  auto it = _last.find(res);
+  return it != _last.end() && !it->second->finished.load(std::memory_order_acquire);
+}
+
+void TaskGraph::wait(int res)
+{
+  //each task waits for the one before it using res, so waiting for the last will do
+  std::vector<_NodePtr> nodes;
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    auto it = _last.find(res);
+    if(it != _last.end())
+      nodes.push_back(it->second);
+  }
+  _waitFor(nodes);
+}
+
+void TaskGraph::wait()
+{
+  std::vector<_NodePtr> nodes;
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    nodes = _nodes;
+  }
+  _waitFor(nodes);
+}
@@ -0,0 +1,83 @@
+#ifndef TASK_GRAPH_H_INCLUDED
+#define TASK_GRAPH_H_INCLUDED
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "thread_pool.h"
+
+/*
+  runs tasks on a ThreadPool in an order given by the resources (integer ids) they
+  use. a task starts when all earlier tasks sharing a resource with it are done,
+  tasks without shared resources run concurrently. each task is a single job on the
+  pool, a task using the pool itself (like the TexOp functions) spreads out over
+  the other threads when it waits.
+
+  tasks are added and waited for by one thread. wait executes jobs on the calling
+  thread, so the tasks make progress even with no workers in the pool.
+
+  note:
+    - the first exception thrown by a task is rethrown by the next call to wait,
+      later tasks still run.
+    - a task must not add or wait for tasks.
+*/
+class TaskGraph
+{
+  struct _Node
+  {
+    TaskGraph* graph;
+    std::function<void()> func;
+    ThreadPool::Batch batch;
+    //unfinished tasks this one waits for, guarded by _lock
+    int deps;
+    std::atomic<bool> finished;
+    std::vector<std::shared_ptr<_Node>> dependents;
+
+    _Node(TaskGraph* g, std::function<void()>&& f):
+      graph(g), func(std::move(f)), batch(_run, this), deps(0), finished(false){}
+  };
+  typedef std::shared_ptr<_Node> _NodePtr;
+
+  ThreadPool& _pool;
+  std::mutex _lock;
+  //last task added for each resource
+  std::map<int, _NodePtr> _last;
+  //tasks not yet released, in order of adding
+  std::vector<_NodePtr> _nodes;
+  std::exception_ptr _error;
+
+  static void _run(void*, int, int);
+  void _prune();
+  void _waitFor(std::vector<_NodePtr>&);
+
+public:
+  void add(std::function<void()>, const std::vector<int>&);
+  //true while a task using resource is unfinished
+  bool busy(int);
+  //waits for the tasks using resource
+  void wait(int);
+  void wait();
+
+  //true on threads executing a task
+  static bool inTask();
+
+  TaskGraph(ThreadPool& pool): _pool(pool){}
+  TaskGraph(const TaskGraph&) = delete;
+  void operator=(const TaskGraph&) = delete;
+
+  ~TaskGraph()
+  {
+    try
+    {
+      wait();
+    }
+    catch(...){}
+  }
+};
+
+#endif
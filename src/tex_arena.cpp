@@ -0,0 +1,418 @@
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common.h"
+
+#include "tex_arena.h"
+
+namespace
+{
+  constexpr size_t _slab_size = 2 << 20;
+  constexpr size_t _huge_page = 2 << 20;
+  //a 128x128 float texture and it's header
+  constexpr size_t _small_limit = (256 << 10) + 16;
+  //the textures have a 16 byte header, the classes are spaced by the texels
+  constexpr size_t _header = 16;
+
+  struct _Slab
+  {
+    _Slab* prev;
+    _Slab* next;
+    //freed cells, and the cells never handed out from fresh on
+    void* free;
+    char* fresh;
+    char* end;
+    unsigned cls;
+    unsigned used;
+    bool partial;
+  };
+  constexpr size_t _slab_header = (sizeof(_Slab) + 15) & ~size_t(15);
+
+  struct _Class
+  {
+    size_t size;
+    //slabs with free cells
+    _Slab* partial;
+  };
+
+  //a slab with no cells in use, or a freed large allocation
+  struct _Idle
+  {
+    void* ptr;
+    size_t size;
+    bool slab;
+  };
+
+  std::mutex _lock;
+  std::vector<_Class> _classes;
+  //most recently freed first
+  std::list<_Idle> _idle;
+  size_t _retained = 256 << 20;
+  TexArena::Stats _stats = {};
+  struct _Large
+  {
+    size_t size;
+    bool scratch;
+  };
+
+  //mapped size of each large allocation in use
+  std::unordered_map<void*, _Large> _large;
+  std::string _scratch_dir;
+  bool _huge_pages = false;
+  void (*_first_touch)(void*, size_t, size_t) = nullptr;
+
+  void _makeClasses()
+  {
+    for(size_t texels = 1 << 10; texels <= _small_limit - _header; texels <<= 1)
+      for(size_t m = 4; m < 8; ++m)
+      {
+        size_t size = _header + texels / 4 * m;
+        if(size > _small_limit)
+          return;
+        _classes.push_back({size, nullptr});
+      }
+  }
+
+  size_t _pageSize()
+  {
+    static size_t page = sysconf(_SC_PAGESIZE);
+    return page;
+  }
+
+  //only allocations of a huge page or more are put on huge pages
+  size_t _largeSize(size_t size)
+  {
+    size_t page = _huge_pages && size >= _huge_page? _huge_page : _pageSize();
+    return (size + page - 1) / page * page;
+  }
+
+  void _adviseHuge(void* ptr, size_t size)
+  {
+#ifdef MADV_HUGEPAGE
+    if(_huge_pages && size % _huge_page == 0)
+      madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+  }
+
+  void _unmap(void* ptr, size_t size)
+  {
+    munmap(ptr, size);
+    _stats.reserved -= size;
+  }
+
+  void _releaseIdle(size_t keep)
+  {
+    while(_stats.idle > keep)
+    {
+      _Idle& idle = _idle.back();
+      _stats.idle -= idle.size;
+      _unmap(idle.ptr, idle.size);
+      _idle.pop_back();
+    }
+  }
+
+  void* _mapAligned(size_t size, size_t align)
+  {
+    if(align <= _pageSize())
+      return mmap(nullptr, size,
+        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    size_t map_size = size + align;
+    void* ptr = mmap(nullptr, map_size,
+      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(ptr == MAP_FAILED)
+      return ptr;
+    char* begin = (char*)ptr;
+    char* aligned = (char*)(((uintptr_t)begin + align - 1) & ~(uintptr_t)(align - 1));
+    if(aligned != begin)
+      munmap(begin, aligned - begin);
+    munmap(aligned + size, begin + map_size - (aligned + size));
+    return aligned;
+  }
+
+  /*
+    slabs are aligned to their size, so the slab of a cell is found from it's
+    address. in huge page mode, explicit huge pages are tried first, they only
+    exist if the system has reserved some. otherwise the mapping is advised to be
+    backed by transparent huge pages.
+  */
+  bool _fits(size_t size)
+  {
+    if(_stats.limit == 0 || _stats.reserved + size <= _stats.limit)
+      return true;
+    _releaseIdle(0);
+    return _stats.reserved + size <= _stats.limit;
+  }
+
+  void* _map(size_t size, size_t align)
+  {
+    if(!_fits(size))
+      throw tgException("texture memory limit of %zu MB exceeded", _stats.limit >> 20);
+
+    void* ptr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if(_huge_pages && size % _huge_page == 0 && align <= _huge_page)
+      ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if(ptr == MAP_FAILED)
+    {
+      ptr = _mapAligned(size, align);
+      if(ptr == MAP_FAILED)
+        throw tgException("unable to allocate %zu bytes of texture memory", size);
+      _adviseHuge(ptr, size);
+    }
+
+    _stats.reserved += size;
+    _stats.peak = std::max(_stats.peak, _stats.reserved);
+    return ptr;
+  }
+
+  //the disk space is allocated up front, so a full disk throws here instead of
+  //faulting when the pages are written back
+  void* _mapScratch(size_t size)
+  {
+    std::string name = _scratch_dir + "/texgen-XXXXXX";
+    std::vector<char> name_buf(name.begin(), name.end());
+    name_buf.push_back('\0');
+    int fd = mkstemp(name_buf.data());
+    if(fd < 0)
+      throw tgException("unable to create a scratch file in \'%s\'",
+        _scratch_dir.c_str());
+    unlink(name_buf.data());
+
+    void* ptr = MAP_FAILED;
+    if(posix_fallocate(fd, 0, size) == 0)
+      ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(ptr == MAP_FAILED)
+      throw tgException("unable to allocate %zu bytes of scratch space", size);
+    _stats.scratch += size;
+    return ptr;
+  }
+
+  //an idle block of the size, most recently freed first
+  void* _takeIdle(size_t size, bool slab)
+  {
+    for(auto it = _idle.begin(); it != _idle.end(); ++it)
+      if(it->slab == slab && it->size == size)
+      {
+        void* ptr = it->ptr;
+        _stats.idle -= size;
+        _idle.erase(it);
+        return ptr;
+      }
+    return nullptr;
+  }
+
+  void _unlinkPartial(_Slab* slab)
+  {
+    _Class& cls = _classes[slab->cls];
+    if(slab->prev != nullptr)
+      slab->prev->next = slab->next;
+    else
+      cls.partial = slab->next;
+    if(slab->next != nullptr)
+      slab->next->prev = slab->prev;
+    slab->partial = false;
+  }
+
+  void _linkPartial(_Slab* slab)
+  {
+    _Class& cls = _classes[slab->cls];
+    slab->prev = nullptr;
+    slab->next = cls.partial;
+    if(cls.partial != nullptr)
+      cls.partial->prev = slab;
+    cls.partial = slab;
+    slab->partial = true;
+  }
+
+  _Slab* _newSlab(unsigned cls)
+  {
+    void* ptr = _takeIdle(_slab_size, true);
+    if(ptr == nullptr)
+      ptr = _map(_slab_size, _slab_size);
+
+    _Slab* slab = (_Slab*)ptr;
+    size_t cells = (_slab_size - _slab_header) / _classes[cls].size;
+    slab->free = nullptr;
+    slab->fresh = (char*)ptr + _slab_header;
+    slab->end = slab->fresh + cells * _classes[cls].size;
+    slab->cls = cls;
+    slab->used = 0;
+    _linkPartial(slab);
+    return slab;
+  }
+
+  void* _allocateCell(unsigned cls)
+  {
+    _Slab* slab = _classes[cls].partial;
+    if(slab == nullptr)
+      slab = _newSlab(cls);
+
+    void* cell;
+    if(slab->free != nullptr)
+    {
+      cell = slab->free;
+      slab->free = *(void**)cell;
+    }
+    else
+    {
+      cell = slab->fresh;
+      slab->fresh += _classes[cls].size;
+    }
+    ++slab->used;
+    if(slab->free == nullptr && slab->fresh == slab->end)
+      _unlinkPartial(slab);
+    _stats.used += _classes[cls].size;
+    return cell;
+  }
+
+  void _deallocateCell(void* cell)
+  {
+    _Slab* slab = (_Slab*)((uintptr_t)cell & ~(uintptr_t)(_slab_size - 1));
+    _stats.used -= _classes[slab->cls].size;
+    *(void**)cell = slab->free;
+    slab->free = cell;
+    if(!slab->partial)
+      _linkPartial(slab);
+    if(--slab->used == 0)
+    {
+      _unlinkPartial(slab);
+      _idle.push_front({slab, _slab_size, true});
+      _stats.idle += _slab_size;
+    }
+  }
+
+  unsigned _classOf(size_t size)
+  {
+    if(_classes.empty())
+      _makeClasses();
+    return std::lower_bound(_classes.begin(), _classes.end(), size,
+      [](const _Class& cls, size_t size){return cls.size < size;}) - _classes.begin();
+  }
+}
+
+namespace TexArena
+{
+  void* allocate(size_t size, size_t texels)
+  {
+    void* ptr;
+    void (*first_touch)(void*, size_t, size_t) = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      if(size <= _small_limit)
+        ptr = _allocateCell(_classOf(size));
+      else
+      {
+        size_t large = _largeSize(size);
+        bool scratch = false;
+        ptr = _takeIdle(large, false);
+        if(ptr != nullptr)
+          _adviseHuge(ptr, large);
+        else if(!_scratch_dir.empty() && !_fits(large))
+        {
+          ptr = _mapScratch(large);
+          scratch = true;
+        }
+        else
+        {
+          ptr = _map(large, large % _huge_page == 0? _huge_page : 0);
+          first_touch = _first_touch;
+        }
+        _large[ptr] = {large, scratch};
+        _stats.used += large;
+      }
+      _stats.requested += size;
+      ++_stats.allocations;
+    }
+    //may run jobs of the thread pool, which allocate themselves
+    if(first_touch != nullptr)
+      first_touch(ptr, size, texels);
+    return ptr;
+  }
+
+  void deallocate(void* ptr, size_t size)
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    if(size <= _small_limit)
+      _deallocateCell(ptr);
+    else
+    {
+      auto it = _large.find(ptr);
+      _Large large = it->second;
+      _large.erase(it);
+      _stats.used -= large.size;
+      if(large.scratch)
+      {
+        munmap(ptr, large.size);
+        _stats.scratch -= large.size;
+      }
+      else
+      {
+        _idle.push_front({ptr, large.size, false});
+        _stats.idle += large.size;
+      }
+    }
+    _stats.requested -= size;
+    --_stats.allocations;
+    _releaseIdle(_retained);
+  }
+
+  void setLimit(size_t limit)
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    _stats.limit = limit;
+  }
+
+  void setRetained(size_t retained)
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    _retained = retained;
+    _releaseIdle(_retained);
+  }
+
+  void setHugePages(bool huge_pages)
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    _huge_pages = huge_pages;
+  }
+
+  void setFirstTouch(void (*first_touch)(void*, size_t, size_t))
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    _first_touch = first_touch;
+  }
+
+  void setScratchDir(const std::string& dir)
+  {
+    struct stat dir_stat;
+    if(!dir.empty() && (stat(dir.c_str(), &dir_stat) != 0 ||
+      !S_ISDIR(dir_stat.st_mode) || access(dir.c_str(), W_OK) != 0))
+      throw tgException("unable to use \'%s\' as scratch directory", dir.c_str());
+    std::lock_guard<std::mutex> lock(_lock);
+    _scratch_dir = dir;
+  }
+
+  void trim()
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    _releaseIdle(0);
+  }
+
+  Stats stats()
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    return _stats;
+  }
+}
@@ -0,0 +1,69 @@
+#ifndef TEX_ARENA_H_INCLUDED
+#define TEX_ARENA_H_INCLUDED
+
+#include <cstddef>
+#include <string>
+
+/*
+  the memory of the textures. allocations up to _small_limit bytes are cells of a
+  size class, the classes are a quarter of a power of 2 apart, and their cells are
+  cut from 2 MB slabs. larger allocations are mapped for themselves, rounded up
+  to whole pages only.
+
+  a slab with no cells in use and a large allocation which is freed are kept idle
+  for reuse, the oldest are returned to the system once more than the retained
+  amount is idle, and all of them by trim. with a limit set, an allocation which
+  would take more memory than the limit first returns the idle memory, and throws
+  if that isn't enough. all functions are thread safe.
+
+  with a scratch directory set, a large allocation which doesn't fit under the
+  limit is mapped from a file there instead of throwing, and the system pages it
+  in and out as it's used. the file is removed at once, so it's space is returned
+  when the allocation is freed or the process ends.
+*/
+namespace TexArena
+{
+  struct Stats
+  {
+    //bytes of the allocations in use, as they were asked for
+    size_t requested;
+    //bytes of the cells and large allocations in use
+    size_t used;
+    //bytes of the idle slabs and large allocations
+    size_t idle;
+    //bytes taken from the system, the most taken at once, and the limit (0 for none)
+    size_t reserved;
+    size_t peak;
+    size_t limit;
+    //allocations in use
+    size_t allocations;
+    //bytes of the allocations in scratch files, counted as used but not reserved
+    size_t scratch;
+  };
+
+  //texels is the number of texels of the texture the memory is for
+  void* allocate(size_t, size_t);
+  //size is the one the memory was allocated with
+  void deallocate(void*, size_t);
+
+  void setLimit(size_t);
+  //the most idle memory kept for reuse
+  void setRetained(size_t);
+  /*
+    puts large allocations of 2 MB or more, and the slabs, on huge pages. set
+    before the textures are made, memory already mapped keeps it's pages.
+  */
+  void setHugePages(bool);
+  //called with each newly mapped large allocation, it's size and number of texels,
+  //outside of the lock, so the pages are first touched by the threads which will
+  //use them
+  void setFirstTouch(void (*)(void*, size_t, size_t));
+  //an empty directory for none, throws if the directory can't be written to
+  void setScratchDir(const std::string&);
+  //returns the idle memory to the system
+  void trim();
+
+  Stats stats();
+}
+
+#endif
@@ -1,19 +1,56 @@
 #include <thread>
 
+#include <unistd.h>
+
 #include "common.h"
 
 #include "texture.h"
 
 #include "tex_op.h"
 #include "tex_op/to_common.h"
+#include "tex_op/to_simd.h"
 
 #include "blurfilter.h"
 
 int _num_threads;
-std::unique_ptr<std::thread[]> _thread_pool;
+ThreadPool _thread_pool;
+//set from the script thread while worker threads may be launching ranges
+std::atomic<TexOp::Scheduling> _scheduling(TexOp::Scheduling::Static);
+
+namespace
+{
+  //the texels of the range are after the 16 byte header, the first range also
+  //touches the header. each page is touched by the range it starts in.
+  void _touchPages(char* mem, size_t size, size_t texel_size, int x, int from, int to)
+  {
+    static const size_t page = sysconf(_SC_PAGESIZE);
+    size_t begin = from == 0? 0 : 16 + (size_t)from * texel_size;
+    size_t end = to == x? size : 16 + (size_t)to * texel_size;
+    for(size_t p = (begin + page - 1) / page * page; p < end; p += page)
+      mem[p] = 0;
+  }
+}
 
 namespace TexOp
 {
+  void setScheduling(Scheduling scheduling)
+  {
+    _scheduling.store(scheduling, std::memory_order_relaxed);
+  }
+  
+  void firstTouch(void* mem, size_t size, size_t texels)
+  {
+    if(texels == 0)
+      return;
+    int x = texels;
+    _launchThreads(x, _touchPages, (char*)mem, size, (size - 16) / texels, x);
+  }
+  
+  ThreadPool& threadPool()
+  {
+    return _thread_pool;
+  }
+  
   void init()
   {
     //#ifndef NDEBUG
@@ -21,11 +58,13 @@ namespace TexOp
     //#else
     _num_threads = std::thread::hardware_concurrency();
     //#endif
-    _thread_pool.reset(new std::thread[_num_threads - 1]);
+    if(_num_threads < 1) _num_threads = 1;
+    _thread_pool.start(_num_threads - 1);
+    _initSimd();
   }
   
   void deinit() noexcept
   {
-    _thread_pool = nullptr;
+    _thread_pool.stop();
   }
 }
\ No newline at end of file
@@ -2,10 +2,14 @@
 #define TEX_OP_H
 
 #include <bitset>
+#include <functional>
 #include <vector>
 
 #include "texture.h"
 #include "blurfilter.h"
+#include "rand.h"
+
+class ThreadPool;
 
 #ifdef SQUSEDOUBLE
 typedef double SQFloat;
@@ -15,10 +19,40 @@ typedef float SQFloat;
 
 namespace TexOp
 {
-  //note: This function destroys the old texture.
-  Texture* resizeTexture(Texture*, int, int);
+  enum class Scheduling
+  {
+    Static,
+    Dynamic
+  };
+  
+  enum class ResizeFilter
+  {
+    Box,
+    Bilinear,
+    Bicubic,
+    Lanczos
+  };
+  
+  //note: This function returns a new texture, the old one is left as it is.
+  Texture* resizeTexture(Texture*, int, int, ResizeFilter = ResizeFilter::Bilinear);
   void copyTexture(Texture*, Texture*, std::bitset<4>);
   
+  /*
+    note:
+      only copyTexture, clear, copyChannel, the filters, generateWhiteNoise and
+      makeNormalMap take planar textures, when all textures passed have the same
+      layout. everything else must be passed interleaved textures.
+  */
+  void setLayout(Texture*, TexHeader::Layout);
+  
+  /*
+    pack stores a texture in it's format, unpack converts it back to floats. no other
+    function takes packed textures.
+    note: These functions destroy the old texture.
+  */
+  Texture* pack(Texture*);
+  Texture* unpack(Texture*);
+  
   void writeRawTexture(Texture*, const uint8_t*);
   void writeRawTexture(Texture*, const float*);
   void readRawTexture(uint8_t*, const Texture*);
@@ -37,6 +71,39 @@ namespace TexOp
   void swapChannels(Texture*, Texture*, std::bitset<4>);
   void blendChannels(Texture*, std::bitset<4>, Texture*, int, float);
   
+  /*
+    pointwise ops recorded to be run later. apply runs them all in one pass over
+    the texture, one block of texels at a time, so a chain of n ops reads and writes
+    the texture once instead of n times. the results are the same as running the
+    ops one after another with the functions below.
+    note: blend needs an interleaved texture, apply then sets the layout.
+  */
+  class PointOps
+  {
+    std::vector<std::function<void(Texture*, int, int)>> _ops;
+    bool _interleaved = false;
+    //number of ops at the last quantize
+    size_t _quantized = 0;
+  public:
+    void clamp(float, float, std::bitset<4>);
+    void filter(float, float, float, float, float, std::bitset<4>);
+    void linearFilter(float, float, float, float, std::bitset<4>);
+    void stencilFilter(float, bool, std::bitset<4>);
+    void downsampleFilter(unsigned, std::bitset<4>);
+    void clear(const Eigen::Array4f&, std::bitset<4>);
+    void blend(const Eigen::Array4f&, const Eigen::Array4f&);
+    //rounds the texels to a reduced precision format, as pack and unpack would
+    void quantize(TexHeader::Format);
+    
+    bool empty() const
+    {
+      return _ops.empty();
+    }
+    //runs the ops on tex and forgets them
+    void apply(Texture*);
+    void discard();
+  };
+  
   void clamp(Texture*, float, float, std::bitset<4>);
   void filter(Texture*, float, float, float, float, float, std::bitset<4>);
   void linearFilter(Texture*, float, float, float, float, std::bitset<4>);
@@ -62,9 +129,12 @@ namespace TexOp
   void blur(Texture*, const Texture*, BlurFilter2d*, float, std::bitset<4>);
   void blurHoriz(Texture*, const Texture*, BlurFilter1d*, float, std::bitset<4>);
   void blurVertic(Texture*, const Texture*, BlurFilter1d*, float, std::bitset<4>);
+  void blurSeparable(Texture*, const Texture*, BlurFilter1d*, BlurFilter1d*,
+    float, std::bitset<4>);
+  void boxBlur(Texture*, const Texture*, unsigned, unsigned, float, std::bitset<4>);
   
-  void generateNoise(Texture*, int, std::bitset<4>);
-  void generateWhiteNoise(Texture*, int, std::bitset<4>);
+  void generateNoise(Texture*, const Rand::Philox&, std::bitset<4>);
+  void generateWhiteNoise(Texture*, const Rand::Philox&, std::bitset<4>);
   void makeTurbulence(Texture*, const Texture*, int, float, std::bitset<4>);
   
   void makeCellNoise(Texture*, std::vector<std::pair<double, double>>&, float,
@@ -77,6 +147,17 @@ namespace TexOp
     
   void makeNormalMap(Texture*, double);
   
+  void setScheduling(Scheduling);
+  /*
+    writes to each page of newly allocated texture memory, split into the same
+    slices as the kernels with static scheduling, so with pinned workers the pages
+    end up on the node of the thread which later works on them. takes the size of
+    the memory and the number of texels, of any format.
+  */
+  void firstTouch(void*, size_t, size_t);
+  //the pool running the kernels, for running work which calls TexOp concurrently
+  ThreadPool& threadPool();
+  
   void init();
   void deinit() noexcept;
 }
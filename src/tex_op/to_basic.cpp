@@ -2,87 +2,160 @@
 #include "../tex_op.h"
 
 #include "to_common.h"
+#include "to_simd.h"
+
+#include <cmath>
+#include <algorithm>
 
 namespace
 {
   //resizing
   /*
-    note:
-      downsizing should be passed the dimensions to be. upsizeing the dimensions that
-      are.
+    the resampler maps dest texel d to source coordinate (d + .5) * scale - .5, with
+    scale = source size / dest size, and wraps around at the edges. when shrinking,
+    the filter is stretched by scale so it covers all the source texels in between.
+    the weights are computed once per row and column and normalized to sum to 1.
   */
-  void _upsizeX(Texture* dest, Texture* src,
-    int width, int ysrs, int ydest)
+  double _filterRadius(TexOp::ResizeFilter filter)
   {
-    for(int y = ysrs; y < ydest; ++y)
+    switch(filter)
     {
-      for(int x = 0; x < width - 1; ++x)
-      {
-        dest->operator()(x * 2, y) = src->operator()(x, y);
-        dest->operator()(x * 2 + 1, y) =
-          src->operator()(x, y) * .5 + src->operator()(x + 1, y) * .5;
-      }
-      dest->operator()((width - 1) * 2, y) =
-        src->operator()(width - 1, y);
-      dest->operator()((width - 1) * 2 + 1, y) =
-        src->operator()(width - 1, y) * .5 + src->operator()(0, y) * .5;
+    case TexOp::ResizeFilter::Box:      return .5;
+    case TexOp::ResizeFilter::Bilinear: return 1.;
+    case TexOp::ResizeFilter::Bicubic:  return 2.;
+    case TexOp::ResizeFilter::Lanczos:  return 3.;
+    default:                            return 1.;
     }
   }
-  void _downsizeX(Texture* dest, Texture* src,
-    int width, int ysrs, int ydest)
+  double _filterWeight(TexOp::ResizeFilter filter, double x)
   {
-    for(int y = ysrs; y < ydest; ++y)
-    for(int x = 0; x < width; ++x)
+    const double a = std::abs(x);
+    switch(filter)
     {
-      dest->operator()(x, y) =
-        src->operator()(x * 2, y) * .5 + src->operator()(x * 2 + 1, y) * .5;
+    case TexOp::ResizeFilter::Box:
+      return x >= -.5 && x < .5? 1. : 0.;
+    case TexOp::ResizeFilter::Bilinear:
+      return a < 1.? 1. - a : 0.;
+    case TexOp::ResizeFilter::Bicubic:
+      //catmull-rom
+      if(a < 1.) return (1.5 * a - 2.5) * a * a + 1.;
+      if(a < 2.) return ((-.5 * a + 2.5) * a - 4.) * a + 2.;
+      return 0.;
+    case TexOp::ResizeFilter::Lanczos:
+      if(a < 1e-8) return 1.;
+      if(a < 3.) return 3. * std::sin(M_PI * x) * std::sin(M_PI * x / 3.) /
+        (M_PI * M_PI * x * x);
+      return 0.;
+    default:
+      return 0.;
     }
   }
-  void _upsizeY(Texture* dest, Texture* src,
-    int width, int ysrs, int ydest)
+  
+  //for each dest texel, taps source indices (wrapped) and their weights
+  struct _ResizeWeights
   {
-    for(int y = ysrs; y < ydest; ++y)
-    for(int x = 0; x < width; ++x)
+    int taps;
+    std::vector<int> index;
+    std::vector<float> weight;
+    
+    _ResizeWeights(int src_size, int dest_size, TexOp::ResizeFilter filter)
     {
-      dest->operator()(x, y * 2) = src->operator()(x, y);
-      dest->operator()(x, y * 2 + 1) =
-        src->operator()(x, y) * .5 + src->operator()(x, y + 1) * .5;
+      const double scale = (double)src_size / dest_size;
+      const double stretch = scale > 1.? scale : 1.;
+      const double support = _filterRadius(filter) * stretch;
+      
+      taps = 0;
+      for(int d = 0; d < dest_size; ++d)
+      {
+        const double center = (d + .5) * scale - .5;
+        int n = (int)std::floor(center + support) - (int)std::ceil(center - support) + 1;
+        taps = std::max(taps, n);
+      }
+      index.assign(dest_size * taps, 0);
+      weight.assign(dest_size * taps, 0.f);
+      
+      std::vector<double> w(taps);
+      for(int d = 0; d < dest_size; ++d)
+      {
+        const double center = (d + .5) * scale - .5;
+        const int first = (int)std::ceil(center - support);
+        double total = 0.;
+        for(int t = 0; t < taps; ++t)
+        {
+          w[t] = _filterWeight(filter, (first + t - center) / stretch);
+          total += w[t];
+        }
+        for(int t = 0; t < taps; ++t)
+        {
+          index[d * taps + t] = ((first + t) % src_size + src_size) % src_size;
+          weight[d * taps + t] = (float)(w[t] / total);
+        }
+      }
     }
-  }
-  void _upsizeYsafe(Texture* dest, Texture* src,
-    int width, int ysrs, int ydest)
+  };
+  
+  void _resizeRows(Texture* dest, const Texture* src,
+    const _ResizeWeights& wx, int from, int to)
   {
-    for(int y = ysrs; y < ydest - 1; ++y)
-    for(int x = 0; x < width; ++x)
+    const int taps = wx.taps;
+    for(int y = from; y < to; ++y)
     {
-      dest->operator()(x, y * 2) = src->operator()(x, y);
-      dest->operator()(x, y * 2 + 1) =
-        src->operator()(x, y) * .5 + src->operator()(x, y + 1) * .5;
-    }
-    for(int x = 0; x < width; ++x)
-    {
-      dest->operator()(x, ydest * 2 - 2) = src->operator()(x, ydest - 1);
-      dest->operator()(x, ydest * 2 - 1) =
-        src->operator()(x, ydest - 1) * .5 + src->operator()(x, 0) * .5;
+      const Eigen::Array4f* src_row = &src->get(0, y);
+      Eigen::Array4f* dest_row = &dest->get(0, y);
+      const int* index = wx.index.data();
+      const float* weight = wx.weight.data();
+      for(unsigned x = 0; x < dest->width; ++x)
+      {
+        Eigen::Array4f sum = src_row[index[0]] * weight[0];
+        for(int t = 1; t < taps; ++t)
+          sum += src_row[index[t]] * weight[t];
+        dest_row[x] = sum;
+        index += taps;
+        weight += taps;
+      }
     }
   }
-  void _downsizeY(Texture* dest, Texture* src,
-    int width, int ysrs, int ydest)
+  void _resizeColumns(Texture* dest, const Texture* src,
+    const _ResizeWeights& wy, int from, int to)
   {
-    for(int y = ysrs; y < ydest; ++y)
-    for(int x = 0; x < width; ++x)
+    const int taps = wy.taps;
+    const int width = dest->width;
+    for(int y = from; y < to; ++y)
     {
-      dest->operator()(x, y) =
-        src->operator()(x, y * 2) * .5 + src->operator()(x, y * 2 + 1) * .5;
+      const int* index = wy.index.data() + y * taps;
+      const float* weight = wy.weight.data() + y * taps;
+      Eigen::Array4f* dest_row = &dest->get(0, y);
+      
+      const Eigen::Array4f* src_row = &src->get(0, index[0]);
+      for(int x = 0; x < width; ++x)
+        dest_row[x] = src_row[x] * weight[0];
+      for(int t = 1; t < taps; ++t)
+      {
+        src_row = &src->get(0, index[t]);
+        for(int x = 0; x < width; ++x)
+          dest_row[x] += src_row[x] * weight[t];
+      }
     }
   }
-
+  
   template<int mask>
   class _copyTex
   {
   public:
     static void func(Texture* dest, Texture* src, int from, int to)
     {
+      if(mask != 0xf && dest->planar())
+      {
+        for(int c = 0; c < 4; ++c) if(mask & (1 << c))
+          std::copy(src->plane(c) + from, src->plane(c) + to, dest->plane(c) + from);
+        return;
+      }
+      if(mask != 0xf && _simd)
+      {
+        _simd->copy(_texels(dest, from), _texels(src, from), to - from, mask);
+        return;
+      }
+      
       auto src_p = src->data() + from;
       auto dest_p = dest->data() + from;
       for(int i = from; i < to; ++i)
@@ -107,6 +180,18 @@ namespace
   public:
     static void func(Texture* tex, const Eigen::Array4f& val, int from, int to)
     {
+      if(tex->planar())
+      {
+        for(int c = 0; c < 4; ++c) if(mask & (1 << c))
+          std::fill(tex->plane(c) + from, tex->plane(c) + to, val[c]);
+        return;
+      }
+      if(mask != 0xf && _simd)
+      {
+        _simd->fill(_texels(tex, from), val.data(), to - from, mask);
+        return;
+      }
+      
       for(int i = from; i < to; ++i)
       {
         if(mask == 0xf) tex->get(i) = val;
@@ -123,6 +208,12 @@ namespace
   
   void _clear(Texture* tex, const Eigen::Array4f &col, int from, int to)
   {
+    if(tex->planar())
+    {
+      for(int c = 0; c < 4; ++c)
+        std::fill(tex->plane(c) + from, tex->plane(c) + to, col[c]);
+      return;
+    }
     for(int i = from; i < to; ++i)
       tex->get(i) = col;
   }
@@ -137,6 +228,19 @@ namespace
     public:
       static void func(Texture* dest, Texture* src, int from, int to)
       {
+        if(dest->planar())
+        {
+          //same order as below, so ch is written last when dest is src
+          const float* src_p = src->plane(ch);
+          for(int k = 1; k <= 4; ++k) if(mask & (1 << (ch + k) % 4))
+          {
+            float* dest_p = dest->plane((ch + k) % 4);
+            if(dest_p != src_p)
+              std::copy(src_p + from, src_p + to, dest_p + from);
+          }
+          return;
+        }
+        
         auto dest_p = dest->data() + from;
         auto src_p = src->data() + from;
         for(int i = from; i < to; ++i)
@@ -152,6 +256,34 @@ namespace
     };
   };
   
+  //layout conversion, src holds a copy of the texels of dest in the old layout
+  void _toPlanar(Texture* dest, const Texture* src, int from, int to)
+  {
+    const float* src_p = (const float*)src->data();
+    float* planes[4] =
+      {dest->plane(0), dest->plane(1), dest->plane(2), dest->plane(3)};
+    for(int i = from; i < to; ++i)
+    {
+      planes[0][i] = src_p[i * 4 + 0];
+      planes[1][i] = src_p[i * 4 + 1];
+      planes[2][i] = src_p[i * 4 + 2];
+      planes[3][i] = src_p[i * 4 + 3];
+    }
+  }
+  void _toInterleaved(Texture* dest, const Texture* src, int from, int to)
+  {
+    float* dest_p = (float*)dest->data();
+    const float* planes[4] =
+      {src->plane(0), src->plane(1), src->plane(2), src->plane(3)};
+    for(int i = from; i < to; ++i)
+    {
+      dest_p[i * 4 + 0] = planes[0][i];
+      dest_p[i * 4 + 1] = planes[1][i];
+      dest_p[i * 4 + 2] = planes[2][i];
+      dest_p[i * 4 + 3] = planes[3][i];
+    }
+  }
+  
   template<int DC, int SC>
   class _swapChannels
   {
@@ -210,74 +342,61 @@ namespace
 
 namespace TexOp
 {
-  Texture* resizeTexture(Texture* tex, int width, int height)
+  Texture* resizeTexture(Texture* tex, int width, int height, ResizeFilter filter)
   {
-    /*
-      note:
-        This might not be the most efficient solution.
-        An iterative approach was taken since the logic for bilinear texturing is more
-        complex, however it instead performs many allocations/deallocations. Those are
-        pooled so might not be very heavy, but they do thrash the cache.
-    */
-  
-    Texture* old_tex;
+    //rows first into a (width * old height) scratch texture, then columns
+    const int old_width = tex->width;
+    const int old_height = tex->height;
+    const auto format = tex->format;
+    if(old_width == width && old_height == height)
+      return makeTexture(*tex);
     
-    int x_samp, y_samp;
-    if((unsigned)width >= tex->width) x_samp = (width / tex->width) / 2;
-    else x_samp = -((tex->width / width) / 2);
-    if((unsigned)height >= tex->height) y_samp = (height / tex->height) / 2;
-    else y_samp = -((tex->height / height) / 2);
-    
-    while(x_samp > 0)
-    {
-      old_tex = tex;
-      int width = old_tex->width;
-      int height = old_tex->height;
-      tex = makeTexture(width * 2, height);
-      
-      _launchThreads(height, _upsizeX, tex, old_tex, width);
-      
-      deleteTexture(old_tex);
-      x_samp /= 2;
-    }
-    while(x_samp < 0)
+    Texture* rows = tex;
+    if(old_width != width)
     {
-      old_tex = tex;
-      int width = old_tex->width;
-      int height = old_tex->height;
-      tex = makeTexture(width / 2, height);
-      
-      _launchThreads(height, _downsizeX, tex, old_tex, width);
-      
-      deleteTexture(old_tex);
-      x_samp /= 2;
+      _ResizeWeights wx(old_width, width, filter);
+      rows = makeTexture(width, old_height);
+      _launchThreadsWeighted(old_height, width * wx.taps,
+        _resizeRows, rows, (const Texture*)tex, std::cref(wx));
     }
-    while(y_samp > 0)
-    {
-      old_tex = tex;
-      int width = old_tex->width;
-      int height = old_tex->height;
-      tex = makeTexture(width, height * 2);
-      
-      _launchThreadsAnd(height, _upsizeY, _upsizeYsafe, tex, old_tex, width);
-      
-      deleteTexture(old_tex);
-      y_samp /= 2;
-    }
-    while(y_samp < 0)
+    
+    Texture* res = rows;
+    if(old_height != height)
     {
-      old_tex = tex;
-      int width = old_tex->width;
-      int height = old_tex->height;
-      tex = makeTexture(width, height / 2);
-      
-      _launchThreads(height, _downsizeY, tex, old_tex, width);
-      
-      deleteTexture(old_tex);
-      y_samp /= 2;
+      _ResizeWeights wy(old_height, height, filter);
+      //the scratch texture is not leaked if there's no memory for the result
+      try
+      {
+        res = makeTexture(width, height);
+      }
+      catch(...)
+      {
+        if(rows != tex)
+          deleteTexture(rows);
+        throw;
+      }
+      _launchThreadsWeighted(height, width * wy.taps,
+        _resizeColumns, res, (const Texture*)rows, std::cref(wy));
+      if(rows != tex)
+        deleteTexture(rows);
     }
     
-    return tex;
+    res->format = format;
+    return res;
+  }
+
+  
+  void setLayout(Texture* tex, TexHeader::Layout layout)
+  {
+    if(tex->layout == layout)
+      return;
+    
+    Texture* old_tex = makeTexture(*tex);
+    if(layout == TexHeader::Layout::Planar)
+      _launchThreads(tex->width * tex->height, _toPlanar, tex, old_tex);
+    else _launchThreads(tex->width * tex->height, _toInterleaved, tex, old_tex);
+    tex->layout = layout;
+    deleteTexture(old_tex);
   }
   
   void copyTexture(Texture* dest, Texture* src, std::bitset<4> mask)
@@ -298,6 +417,26 @@ namespace TexOp
     _launchThreads(elements, _clear, tex, color);
   }
   
+  void PointOps::clear(const Eigen::Array4f& color, std::bitset<4> mask)
+  {
+    //the color is stored unaligned, std::function may not align it's captures
+    std::array<float, 4> col = {{color[0], color[1], color[2], color[3]}};
+    if(mask.all())
+    {
+      _ops.emplace_back([col](Texture* tex, int from, int to)
+      {
+        _clear(tex, Eigen::Array4f(col[0], col[1], col[2], col[3]), from, to);
+      });
+      return;
+    }
+    auto func = _maskedFunc<_clearChannels>(mask.to_ulong());
+    if(func)
+      _ops.emplace_back([col, func](Texture* tex, int from, int to)
+      {
+        func(tex, Eigen::Array4f(col[0], col[1], col[2], col[3]), from, to);
+      });
+  }
+  
   void copyChannel(Texture* dest, std::bitset<4> mask, Texture* src, int ch)
   {
     _launchThreadsCh2Masked<_copyChannel>(ch, mask.to_ulong(), dest, src);
@@ -2,6 +2,7 @@
 #include "../tex_op.h"
 
 #include "to_common.h"
+#include "to_simd.h"
 
 namespace
 {
@@ -11,6 +12,12 @@ namespace
     const Eigen::Array4f &blend,
     int from, int to)
   {
+    if(_simd)
+    {
+      _simd->lerpColor(_texels(tex, from), chs.data(), blend.data(), to - from);
+      return;
+    }
+    
     Eigen::Array4f r_blend = Eigen::Array4f(1., 1., 1., 1.) - blend;
     for(int i = from; i < to; ++i)
       tex->get(i) = tex->get(i) * r_blend + chs * blend;
@@ -32,16 +39,16 @@ namespace
         {
           if(mask & (1 << (ch + 1) % 4))
             (*dest_p)[(ch + 1) % 4] =
-              (*src_p)[ch] * blend + (*dest_p)[(ch + 1) % 4] * (1. - blend);
+              (*src_p)[ch] * blend + (*dest_p)[(ch + 1) % 4] * (1.f - blend);
           if(mask & (1 << (ch + 2) % 4))
             (*dest_p)[(ch + 2) % 4] =
-              (*src_p)[ch] * blend + (*dest_p)[(ch + 2) % 4] * (1. - blend);
+              (*src_p)[ch] * blend + (*dest_p)[(ch + 2) % 4] * (1.f - blend);
           if(mask & (1 << (ch + 3) % 4))
             (*dest_p)[(ch + 3) % 4] =
-              (*src_p)[ch] * blend + (*dest_p)[(ch + 3) % 4] * (1. - blend);
+              (*src_p)[ch] * blend + (*dest_p)[(ch + 3) % 4] * (1.f - blend);
           if(mask & (1 << (ch    ) % 4))
             (*dest_p)[(ch    ) % 4] =
-              (*src_p)[ch] * blend + (*dest_p)[(ch    ) % 4] * (1. - blend);
+              (*src_p)[ch] * blend + (*dest_p)[(ch    ) % 4] * (1.f - blend);
           ++dest_p;
           ++src_p;
         }
@@ -59,27 +66,34 @@ namespace
     public:
       static void func(Texture* dest, Texture* src, Texture* a_tex, int from, int to)
       {
+        if(_simd)
+        {
+          _simd->lerpAlpha[ch](_texels(dest, from), _texels(src, from),
+            _texels(a_tex, from), to - from, mask);
+          return;
+        }
+        
         for(int i = from; i < to; ++i)
         {
           float blend_fac = a_tex->get(i)[ch];
           if(mask == 0xf)
           {
-            dest->get(i) = dest->get(i) * (1. - blend_fac) + src->get(i) * blend_fac;
+            dest->get(i) = dest->get(i) * (1.f - blend_fac) + src->get(i) * blend_fac;
           }
           else
           {
             if(mask & 1)
               dest->get(i)[0] = 
-                dest->get(i)[0] * (1. - blend_fac) + src->get(i)[0] * blend_fac;
+                dest->get(i)[0] * (1.f - blend_fac) + src->get(i)[0] * blend_fac;
             if(mask & 2)
               dest->get(i)[1] = 
-                dest->get(i)[1] * (1. - blend_fac) + src->get(i)[1] * blend_fac;
+                dest->get(i)[1] * (1.f - blend_fac) + src->get(i)[1] * blend_fac;
             if(mask & 4)
               dest->get(i)[2] = 
-                dest->get(i)[2] * (1. - blend_fac) + src->get(i)[2] * blend_fac;
+                dest->get(i)[2] * (1.f - blend_fac) + src->get(i)[2] * blend_fac;
             if(mask & 8)
               dest->get(i)[3] = 
-                dest->get(i)[3] * (1. - blend_fac) + src->get(i)[3] * blend_fac;
+                dest->get(i)[3] * (1.f - blend_fac) + src->get(i)[3] * blend_fac;
           }
         }
       }
@@ -92,22 +106,28 @@ namespace
   public:
     static void func(Texture* dest, Texture* src, float blend, int from, int to)
     {
+      if(_simd)
+      {
+        _simd->merge(_texels(dest, from), _texels(src, from), blend, to - from, mask);
+        return;
+      }
+      
       for(int i = from; i < to; ++i)
       {
         if(mask == 0xf)
         {
-          dest->get(i) = dest->get(i) * (1. - blend) * src->get(i) * blend;
+          dest->get(i) = dest->get(i) * (1.f - blend) * src->get(i) * blend;
         }
         else
         {
           if(mask & 1) dest->get(i)[0] =
-            dest->get(i)[0] * (1. - blend) * src->get(i)[0] * blend;
+            dest->get(i)[0] * (1.f - blend) * src->get(i)[0] * blend;
           if(mask & 2) dest->get(i)[1] =
-            dest->get(i)[1] * (1. - blend) * src->get(i)[1] * blend;
+            dest->get(i)[1] * (1.f - blend) * src->get(i)[1] * blend;
           if(mask & 4) dest->get(i)[2] =
-            dest->get(i)[2] * (1. - blend) * src->get(i)[2] * blend;
+            dest->get(i)[2] * (1.f - blend) * src->get(i)[2] * blend;
           if(mask & 8) dest->get(i)[3] =
-            dest->get(i)[3] * (1. - blend) * src->get(i)[3] * blend;
+            dest->get(i)[3] * (1.f - blend) * src->get(i)[3] * blend;
         }
       }
     }
@@ -131,19 +151,19 @@ namespace
           if(mask & (1 << (ch + 1) % 4))
             (*dest_p)[(ch + 1) % 4] =
               (*src_p)[ch] * (*dest_p)[(ch + 1) % 4] +
-              (1. - (*src_p)[ch]) * val[(ch + 1) % 4];
+              (1.f - (*src_p)[ch]) * val[(ch + 1) % 4];
           if(mask & (1 << (ch + 2) % 4))
             (*dest_p)[(ch + 2) % 4] =
               (*src_p)[ch] * (*dest_p)[(ch + 2) % 4] +
-              (1. - (*src_p)[ch]) * val[(ch + 2) % 4];
+              (1.f - (*src_p)[ch]) * val[(ch + 2) % 4];
           if(mask & (1 << (ch + 3) % 4))
             (*dest_p)[(ch + 3) % 4] =
               (*src_p)[ch] * (*dest_p)[(ch + 3) % 4] +
-              (1. - (*src_p)[ch]) * val[(ch + 3) % 4];
+              (1.f - (*src_p)[ch]) * val[(ch + 3) % 4];
           if(mask & (1 << (ch    ) % 4))
             (*dest_p)[(ch    ) % 4] =
               (*src_p)[ch] * (*dest_p)[(ch    ) % 4] +
-              (1. - (*src_p)[ch]) * val[(ch    ) % 4];
+              (1.f - (*src_p)[ch]) * val[(ch    ) % 4];
           ++dest_p;
           ++src_p;
         }
@@ -168,19 +188,19 @@ namespace
         {
           if(mask & (1 << (ch + 1) % 4))
             (*dest_p)[(ch + 1) % 4] =
-              (1. - (*src_p)[ch]) * (*dest_p)[(ch + 1) % 4] +
+              (1.f - (*src_p)[ch]) * (*dest_p)[(ch + 1) % 4] +
               (*src_p)[ch] * val[(ch + 1) % 4];
           if(mask & (1 << (ch + 2) % 4))
             (*dest_p)[(ch + 2) % 4] =
-              (1. - (*src_p)[ch]) * (*dest_p)[(ch + 2) % 4] +
+              (1.f - (*src_p)[ch]) * (*dest_p)[(ch + 2) % 4] +
               (*src_p)[ch] * val[(ch + 2) % 4];
           if(mask & (1 << (ch + 3) % 4))
             (*dest_p)[(ch + 3) % 4] =
-              (1. - (*src_p)[ch]) * (*dest_p)[(ch + 3) % 4] +
+              (1.f - (*src_p)[ch]) * (*dest_p)[(ch + 3) % 4] +
               (*src_p)[ch] * val[(ch + 3) % 4];
           if(mask & (1 << (ch    ) % 4))
             (*dest_p)[(ch    ) % 4] =
-              (1. - (*src_p)[ch]) * (*dest_p)[(ch    ) % 4] +
+              (1.f - (*src_p)[ch]) * (*dest_p)[(ch    ) % 4] +
               (*src_p)[ch] * val[(ch    ) % 4];
           ++dest_p;
           ++src_p;
@@ -220,6 +240,12 @@ namespace
   public:
     static void func(Texture* dest, Texture* src, int from, int to)
     {
+      if(_simd)
+      {
+        _simd->diff(_texels(dest, from), _texels(src, from), to - from, mask);
+        return;
+      }
+      
       for(int i = from; i < to; ++i)
       {
         if(mask & 0x1) dest->get(i)[0] = fabs(dest->get(i)[0] - src->get(i)[0]);
@@ -239,6 +265,20 @@ namespace TexOp
     _launchThreads(elements, _blend, tex, color, mask);
   }
   
+  void PointOps::blend(const Eigen::Array4f& color, const Eigen::Array4f& mask)
+  {
+    std::array<float, 4> col = {{color[0], color[1], color[2], color[3]}};
+    std::array<float, 4> bld = {{mask[0], mask[1], mask[2], mask[3]}};
+    _ops.emplace_back([col, bld](Texture* tex, int from, int to)
+    {
+      _blend(tex,
+        Eigen::Array4f(col[0], col[1], col[2], col[3]),
+        Eigen::Array4f(bld[0], bld[1], bld[2], bld[3]),
+        from, to);
+    });
+    _interleaved = true;
+  }
+  
   void blendChannels(
     Texture* dest,
     std::bitset<4> mask,
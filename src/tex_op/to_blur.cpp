@@ -5,37 +5,107 @@
 
 namespace
 {
+  //wraps i into [0, n)
+  inline int _wrap(int i, int n)
+  {
+    i %= n;
+    return i < 0? i + n : i;
+  }
+  
+  //adds the taps of a filter along a row to out[0, x1 - x0), taps past the ends of
+  //the row wrap around. only texels within the filter radius of the ends need to
+  //wrap, the rest read the row directly
+  inline void _collectRow(
+    Eigen::Array4f* out, const Eigen::Array4f* row, int width,
+    const float* weights, int size, int x0, int x1)
+  {
+    const int half = size / 2;
+    const int lo = std::min(std::max(half, x0), x1);
+    const int hi = std::max(std::min(width - size + half + 1, x1), lo);
+    
+    for(int x = x0; x < lo; ++x)
+    {
+      int k = _wrap(x - half, width);
+      for(int j = 0; j < size; ++j)
+      {
+        out[x - x0] += row[k] * weights[j];
+        if(++k == width) k = 0;
+      }
+    }
+    for(int x = lo; x < hi; ++x)
+    {
+      const Eigen::Array4f* taps = row + x - half;
+      for(int j = 0; j < size; ++j)
+        out[x - x0] += taps[j] * weights[j];
+    }
+    for(int x = hi; x < x1; ++x)
+    {
+      int k = _wrap(x - half, width);
+      for(int j = 0; j < size; ++j)
+      {
+        out[x - x0] += row[k] * weights[j];
+        if(++k == width) k = 0;
+      }
+    }
+  }
+  
+  //adds the taps of a filter along the columns x0 to x1 to out[0, x1 - x0)
+  inline void _collectColumns(
+    Eigen::Array4f* out, const Texture* src,
+    const float* weights, int size, int x0, int x1, int y)
+  {
+    int k = _wrap(y - size / 2, src->height);
+    for(int j = 0; j < size; ++j)
+    {
+      const Eigen::Array4f* row = src->data() + k * src->width;
+      for(int x = x0; x < x1; ++x)
+        out[x - x0] += row[x] * weights[j];
+      if(++k == (int)src->height) k = 0;
+    }
+  }
+  
+  inline void _clearCollected(Eigen::Array4f* out, int n)
+  {
+    for(int i = 0; i < n; ++i)
+      out[i] << 0., 0., 0., 0.;
+  }
+  
   template<int mask>
   class _blur
   {
   public:
     static void func(
-      Texture* dest, const Texture* src, BlurFilter2d* filt, int from, int to)
+      Texture* dest, const Texture* src, BlurFilter2d* filt,
+      int x0, int y0, int x1, int y1)
     {
-      for(int i = from; i < to; ++i)
+      Eigen::Array4f collected[_tile_size];
+      for(int y = y0; y < y1; ++y)
       {
-        unsigned x = i % src->width;
-        unsigned y = i / src->width;
-        
-        Eigen::Array4f collector(0., 0., 0., 0.);
+        _clearCollected(collected, x1 - x0);
+        int k = _wrap(y - filt->height / 2, src->height);
         for(unsigned _y = 0; _y < filt->height; ++_y)
-        for(unsigned _x = 0; _x < filt->width; ++_x)
         {
-          collector += src->getBounded(
-            x - filt->width / 2 + _x,
-            y - filt->height / 2 + _y)
-            * filt->get(_x, _y);
+          _collectRow(collected, src->data() + k * src->width, src->width,
+            &filt->get(0, _y), filt->width, x0, x1);
+          if(++k == (int)src->height) k = 0;
         }
-        collector /= filt->weight;
-        if(mask == 0xf)
-          dest->get(i) = collector;
-        else
+        
+        for(int x = x0; x < x1; ++x)
         {
-          dest->get(i) = src->get(i);
-          if(mask & 1) dest->get(i)[0] = collector[0];
-          if(mask & 2) dest->get(i)[1] = collector[1];
-          if(mask & 4) dest->get(i)[2] = collector[2];
-          if(mask & 8) dest->get(i)[3] = collector[3];
+          int i = x + y * src->width;
+          
+          Eigen::Array4f collector = collected[x - x0];
+          collector /= filt->weight;
+          if(mask == 0xf)
+            dest->get(i) = collector;
+          else
+          {
+            dest->get(i) = src->get(i);
+            if(mask & 1) dest->get(i)[0] = collector[0];
+            if(mask & 2) dest->get(i)[1] = collector[1];
+            if(mask & 4) dest->get(i)[2] = collector[2];
+            if(mask & 8) dest->get(i)[3] = collector[3];
+          }
         }
       }
     }
@@ -46,38 +116,43 @@ namespace
   {
   public:
     static void func(
-      Texture* dest, const Texture* src, BlurFilter2d* filt, float f, int from, int to)
+      Texture* dest, const Texture* src, BlurFilter2d* filt, float f,
+      int x0, int y0, int x1, int y1)
     {
-      for(int i = from; i < to; ++i)
+      Eigen::Array4f collected[_tile_size];
+      for(int y = y0; y < y1; ++y)
       {
-        unsigned x = i % src->width;
-        unsigned y = i / src->width;
-        
-        Eigen::Array4f collector(0., 0., 0., 0.);
+        _clearCollected(collected, x1 - x0);
+        int k = _wrap(y - filt->height / 2, src->height);
         for(unsigned _y = 0; _y < filt->height; ++_y)
-        for(unsigned _x = 0; _x < filt->width; ++_x)
         {
-          collector += src->getBounded(
-            x - filt->width / 2 + _x,
-            y - filt->height / 2 + _y)
-            * filt->get(_x, _y);
+          _collectRow(collected, src->data() + k * src->width, src->width,
+            &filt->get(0, _y), filt->width, x0, x1);
+          if(++k == (int)src->height) k = 0;
         }
-        collector /= filt->weight;
-        collector *= f;
-        dest->get(i) *= 1. - f;
-        if(mask == 0xf)
-          dest->get(i) += collector;
-        else
+        
+        for(int x = x0; x < x1; ++x)
         {
-          Eigen::Array4f current = src->get(i);
-          if(mask & 1) dest->get(i)[0] += collector[0];
-          else dest->get(i)[0] = current[0];
-          if(mask & 2) dest->get(i)[1] += collector[1];
-          else dest->get(i)[1] = current[1];
-          if(mask & 4) dest->get(i)[2] += collector[2];
-          else dest->get(i)[2] = current[2];
-          if(mask & 8) dest->get(i)[3] += collector[3];
-          else dest->get(i)[3] = current[3];
+          int i = x + y * src->width;
+          
+          Eigen::Array4f collector = collected[x - x0];
+          collector /= filt->weight;
+          collector *= f;
+          dest->get(i) *= 1. - f;
+          if(mask == 0xf)
+            dest->get(i) += collector;
+          else
+          {
+            Eigen::Array4f current = src->get(i);
+            if(mask & 1) dest->get(i)[0] += collector[0];
+            else dest->get(i)[0] = current[0];
+            if(mask & 2) dest->get(i)[1] += collector[1];
+            else dest->get(i)[1] = current[1];
+            if(mask & 4) dest->get(i)[2] += collector[2];
+            else dest->get(i)[2] = current[2];
+            if(mask & 8) dest->get(i)[3] += collector[3];
+            else dest->get(i)[3] = current[3];
+          }
         }
       }
     }
@@ -88,30 +163,32 @@ namespace
   {
   public:
     static void func(
-      Texture* dest, const Texture* src, BlurFilter1d* filt, int from, int to)
+      Texture* dest, const Texture* src, BlurFilter1d* filt,
+      int x0, int y0, int x1, int y1)
     {
-      for(int i = from; i < to; ++i)
+      Eigen::Array4f collected[_tile_size];
+      for(int y = y0; y < y1; ++y)
       {
-        unsigned x = i % src->width;
-        unsigned y = i / src->width;
+        _clearCollected(collected, x1 - x0);
+        _collectRow(collected, src->data() + y * src->width, src->width,
+          &filt->get(0), filt->size, x0, x1);
         
-        Eigen::Array4f collector(0., 0., 0., 0.);
-        for(unsigned j = 0; j < filt->size; ++j)
-        {
-          collector += src->getBounded(
-            x - filt->size / 2 + j, y)
-            * filt->get(j);
-        }
-        collector /= filt->weight;
-        if(mask == 0xf)
-          dest->get(i) = collector;
-        else
+        for(int x = x0; x < x1; ++x)
         {
-          dest->get(i) = src->get(i);
-          if(mask & 1) dest->get(i)[0] = collector[0];
-          if(mask & 2) dest->get(i)[1] = collector[1];
-          if(mask & 4) dest->get(i)[2] = collector[2];
-          if(mask & 8) dest->get(i)[3] = collector[3];
+          int i = x + y * src->width;
+          
+          Eigen::Array4f collector = collected[x - x0];
+          collector /= filt->weight;
+          if(mask == 0xf)
+            dest->get(i) = collector;
+          else
+          {
+            dest->get(i) = src->get(i);
+            if(mask & 1) dest->get(i)[0] = collector[0];
+            if(mask & 2) dest->get(i)[1] = collector[1];
+            if(mask & 4) dest->get(i)[2] = collector[2];
+            if(mask & 8) dest->get(i)[3] = collector[3];
+          }
         }
       }
     }
@@ -122,36 +199,38 @@ namespace
   {
   public:
     static void func(
-      Texture* dest, const Texture* src, BlurFilter1d* filt, float f, int from, int to)
+      Texture* dest, const Texture* src, BlurFilter1d* filt, float f,
+      int x0, int y0, int x1, int y1)
     {
-      for(int i = from; i < to; ++i)
+      Eigen::Array4f collected[_tile_size];
+      for(int y = y0; y < y1; ++y)
       {
-        unsigned x = i % src->width;
-        unsigned y = i / src->width;
+        _clearCollected(collected, x1 - x0);
+        _collectRow(collected, src->data() + y * src->width, src->width,
+          &filt->get(0), filt->size, x0, x1);
         
-        Eigen::Array4f collector(0., 0., 0., 0.);
-        for(unsigned j = 0; j < filt->size; ++j)
+        for(int x = x0; x < x1; ++x)
         {
-          collector += src->getBounded(
-            x - filt->size / 2 + j, y)
-            * filt->get(j);
-        }
-        collector /= filt->weight;
-        collector *= f;
-        dest->get(i) *= 1. - f;
-        if(mask == 0xf)
-          dest->get(i) += collector;
-        else
-        {
-          Eigen::Array4f current = src->get(i);
-          if(mask & 1) dest->get(i)[0] += collector[0];
-          else dest->get(i)[0] = current[0];
-          if(mask & 2) dest->get(i)[1] += collector[1];
-          else dest->get(i)[1] = current[1];
-          if(mask & 4) dest->get(i)[2] += collector[2];
-          else dest->get(i)[2] = current[2];
-          if(mask & 8) dest->get(i)[3] += collector[3];
-          else dest->get(i)[3] = current[3];
+          int i = x + y * src->width;
+          
+          Eigen::Array4f collector = collected[x - x0];
+          collector /= filt->weight;
+          collector *= f;
+          dest->get(i) *= 1. - f;
+          if(mask == 0xf)
+            dest->get(i) += collector;
+          else
+          {
+            Eigen::Array4f current = src->get(i);
+            if(mask & 1) dest->get(i)[0] += collector[0];
+            else dest->get(i)[0] = current[0];
+            if(mask & 2) dest->get(i)[1] += collector[1];
+            else dest->get(i)[1] = current[1];
+            if(mask & 4) dest->get(i)[2] += collector[2];
+            else dest->get(i)[2] = current[2];
+            if(mask & 8) dest->get(i)[3] += collector[3];
+            else dest->get(i)[3] = current[3];
+          }
         }
       }
     }
@@ -162,30 +241,31 @@ namespace
   {
   public:
     static void func(
-      Texture* dest, const Texture* src, BlurFilter1d* filt, int from, int to)
+      Texture* dest, const Texture* src, BlurFilter1d* filt,
+      int x0, int y0, int x1, int y1)
     {
-      for(int i = from; i < to; ++i)
+      Eigen::Array4f collected[_tile_size];
+      for(int y = y0; y < y1; ++y)
       {
-        unsigned x = i % src->width;
-        unsigned y = i / src->width;
+        _clearCollected(collected, x1 - x0);
+        _collectColumns(collected, src, &filt->get(0), filt->size, x0, x1, y);
         
-        Eigen::Array4f collector(0., 0., 0., 0.);
-        for(unsigned j = 0; j < filt->size; ++j)
+        for(int x = x0; x < x1; ++x)
         {
-          collector += src->getBounded(
-            x, y - filt->size / 2 + j)
-            * filt->get(j);
-        }
-        collector /= filt->weight;
-        if(mask == 0xf)
-          dest->get(i) = collector;
-        else
-        {
-          dest->get(i) = src->get(i);
-          if(mask & 1) dest->get(i)[0] = collector[0];
-          if(mask & 2) dest->get(i)[1] = collector[1];
-          if(mask & 4) dest->get(i)[2] = collector[2];
-          if(mask & 8) dest->get(i)[3] = collector[3];
+          int i = x + y * src->width;
+          
+          Eigen::Array4f collector = collected[x - x0];
+          collector /= filt->weight;
+          if(mask == 0xf)
+            dest->get(i) = collector;
+          else
+          {
+            dest->get(i) = src->get(i);
+            if(mask & 1) dest->get(i)[0] = collector[0];
+            if(mask & 2) dest->get(i)[1] = collector[1];
+            if(mask & 4) dest->get(i)[2] = collector[2];
+            if(mask & 8) dest->get(i)[3] = collector[3];
+          }
         }
       }
     }
@@ -196,36 +276,132 @@ namespace
   {
   public:
     static void func(
-      Texture* dest, const Texture* src, BlurFilter1d* filt, float f, int from, int to)
+      Texture* dest, const Texture* src, BlurFilter1d* filt, float f,
+      int x0, int y0, int x1, int y1)
     {
-      for(int i = from; i < to; ++i)
+      Eigen::Array4f collected[_tile_size];
+      for(int y = y0; y < y1; ++y)
       {
-        unsigned x = i % src->width;
-        unsigned y = i / src->width;
+        _clearCollected(collected, x1 - x0);
+        _collectColumns(collected, src, &filt->get(0), filt->size, x0, x1, y);
         
-        Eigen::Array4f collector(0., 0., 0., 0.);
-        for(unsigned j = 0; j < filt->size; ++j)
+        for(int x = x0; x < x1; ++x)
+        {
+          int i = x + y * src->width;
+          
+          Eigen::Array4f collector = collected[x - x0];
+          collector /= filt->weight;
+          collector *= f;
+          dest->get(i) *= 1. - f;
+          if(mask == 0xf)
+            dest->get(i) += collector;
+          else
+          {
+            Eigen::Array4f current = src->get(i);
+            if(mask & 1) dest->get(i)[0] += collector[0];
+            else dest->get(i)[0] = current[0];
+            if(mask & 2) dest->get(i)[1] += collector[1];
+            else dest->get(i)[1] = current[1];
+            if(mask & 4) dest->get(i)[2] += collector[2];
+            else dest->get(i)[2] = current[2];
+            if(mask & 8) dest->get(i)[3] += collector[3];
+            else dest->get(i)[3] = current[3];
+          }
+        }
+      }
+    }
+  };
+  
+  //running sum box blur, cost per texel is independent of radius
+  void _boxBlurRows(
+    Texture* dest, const Texture* src, unsigned radius, int from, int to)
+  {
+    const unsigned w = src->width;
+    const double norm = 1. / (radius * 2 + 1);
+    for(int y = from; y < to; ++y)
+    {
+      const Eigen::Array4f* row = src->data() + y * w;
+      Eigen::Array4f* out = dest->data() + y * w;
+      
+      Eigen::Array4d sum(0., 0., 0., 0.);
+      for(int k = -(int)radius; k <= (int)radius; ++k)
+        sum += row[(k % (int)w + w) % w].cast<double>();
+      
+      unsigned add = (radius + 1) % w;
+      unsigned sub = (w - radius % w) % w;
+      for(unsigned x = 0; x < w; ++x)
+      {
+        out[x] = (sum * norm).cast<float>();
+        sum += row[add].cast<double>();
+        sum -= row[sub].cast<double>();
+        if(++add == w) add = 0;
+        if(++sub == w) sub = 0;
+      }
+    }
+  }
+  
+  //same as above, but down columns, _tile_size columns at a time
+  void _boxBlurColumns(
+    Texture* dest, const Texture* src, unsigned radius, int from, int to)
+  {
+    const unsigned w = src->width;
+    const unsigned h = src->height;
+    const double norm = 1. / (radius * 2 + 1);
+    Eigen::Array4d sums[_tile_size];
+    for(int b = from; b < to; ++b)
+    {
+      const unsigned x0 = b * _tile_size;
+      const unsigned x1 = x0 + _tile_size < w? x0 + _tile_size : w;
+      
+      for(unsigned x = x0; x < x1; ++x)
+        sums[x - x0] << 0., 0., 0., 0.;
+      for(int k = -(int)radius; k <= (int)radius; ++k)
+      {
+        const Eigen::Array4f* row = src->data() + ((k % (int)h + h) % h) * w;
+        for(unsigned x = x0; x < x1; ++x)
+          sums[x - x0] += row[x].cast<double>();
+      }
+      
+      unsigned add = (radius + 1) % h;
+      unsigned sub = (h - radius % h) % h;
+      for(unsigned y = 0; y < h; ++y)
+      {
+        Eigen::Array4f* out = dest->data() + y * w;
+        const Eigen::Array4f* add_row = src->data() + add * w;
+        const Eigen::Array4f* sub_row = src->data() + sub * w;
+        for(unsigned x = x0; x < x1; ++x)
         {
-          collector += src->getBounded(
-            x, y - filt->size / 2 + j)
-            * filt->get(j);
+          out[x] = (sums[x - x0] * norm).cast<float>();
+          sums[x - x0] += add_row[x].cast<double>();
+          sums[x - x0] -= sub_row[x].cast<double>();
         }
-        collector /= filt->weight;
-        collector *= f;
-        dest->get(i) *= 1. - f;
+        if(++add == h) add = 0;
+        if(++sub == h) sub = 0;
+      }
+    }
+  }
+  
+  template<int mask>
+  class _blendBlurred
+  {
+  public:
+    static void func(Texture* dest, const Texture* blurred, const Texture* src,
+      float f, int from, int to)
+    {
+      for(int i = from; i < to; ++i)
+      {
+        Eigen::Array4f collector = blurred->get(i);
+        if(f != 1.)
+          collector = src->get(i) * (1.f - f) + collector * f;
         if(mask == 0xf)
-          dest->get(i) += collector;
+          dest->get(i) = collector;
         else
         {
-          Eigen::Array4f current = src->get(i);
-          if(mask & 1) dest->get(i)[0] += collector[0];
-          else dest->get(i)[0] = current[0];
-          if(mask & 2) dest->get(i)[1] += collector[1];
-          else dest->get(i)[1] = current[1];
-          if(mask & 4) dest->get(i)[2] += collector[2];
-          else dest->get(i)[2] = current[2];
-          if(mask & 8) dest->get(i)[3] += collector[3];
-          else dest->get(i)[3] = current[3];
+          dest->get(i) = src->get(i);
+          if(mask & 1) dest->get(i)[0] = collector[0];
+          if(mask & 2) dest->get(i)[1] = collector[1];
+          if(mask & 4) dest->get(i)[2] = collector[2];
+          if(mask & 8) dest->get(i)[3] = collector[3];
         }
       }
     }
@@ -238,23 +414,78 @@ namespace TexOp
     float f, std::bitset<4> mask)
   {
     if(f == 1.)
-      _launchThreadsMasked<_blur>(mask.to_ulong(), dest, src, filter);
-    else _launchThreadsMasked<_blurf>(mask.to_ulong(), dest, src, filter, f);
+      _launchThreadsTiledMasked<_blur>(mask.to_ulong(), dest, src, filter);
+    else _launchThreadsTiledMasked<_blurf>(mask.to_ulong(), dest, src, filter, f);
   }
   
   void blurHoriz(Texture* dest, const Texture* src, BlurFilter1d* filter,
     float f, std::bitset<4> mask)
   {
     if(f == 1.)
-      _launchThreadsMasked<_blurHoriz>(mask.to_ulong(), dest, src, filter);
-    else _launchThreadsMasked<_blurHorizf>(mask.to_ulong(), dest, src, filter, f);
+      _launchThreadsTiledMasked<_blurHoriz>(mask.to_ulong(), dest, src, filter);
+    else _launchThreadsTiledMasked<_blurHorizf>(mask.to_ulong(), dest, src, filter, f);
   }
   
   void blurVertic(Texture* dest, const Texture* src, BlurFilter1d* filter,
     float f, std::bitset<4> mask)
   {
     if(f == 1.)
-      _launchThreadsMasked<_blurVertic>(mask.to_ulong(), dest, src, filter);
-    else _launchThreadsMasked<_blurVerticf>(mask.to_ulong(), dest, src, filter, f);
+      _launchThreadsTiledMasked<_blurVertic>(mask.to_ulong(), dest, src, filter);
+    else _launchThreadsTiledMasked<_blurVerticf>(mask.to_ulong(), dest, src, filter, f);
   }
-}
+  
+  void blurSeparable(Texture* dest, const Texture* src,
+    BlurFilter1d* filter_x, BlurFilter1d* filter_y, float f, std::bitset<4> mask)
+  {
+    /*
+      note:
+        equivalent to blur with the filter filter_x * filter_y, but takes
+        filter_x->size + filter_y->size taps per texel instead of their product.
+        the horizontal pass goes to a scratch texture from the pool, the vertical
+        pass reads it and writes dest. channels outside of mask are carried
+        through the scratch texture unchanged.
+    */
+    Texture* scratch = makeTexture(src->width, src->height);
+    blurHoriz(scratch, src, filter_x, 1., mask);
+    blurVertic(dest, scratch, filter_y, f, mask);
+    deleteTexture(scratch);
+  }
+  
+  void boxBlur(Texture* dest, const Texture* src,
+    unsigned level_x, unsigned level_y, float f, std::bitset<4> mask)
+  {
+    /*
+      note:
+        approximates blurSeparable with BlurFilter1d filters of the same levels,
+        using BoxFilter1d::passes running sum passes in each direction. unlike the
+        other blur functions f blends the result with src rather than with dest.
+        the passes alternate between dest and a scratch texture from the pool.
+    */
+    BoxFilter1d box_x(level_x);
+    BoxFilter1d box_y(level_y);
+    
+    Texture* scratch = makeTexture(src->width, src->height);
+    Texture* buffers[2] = {dest, scratch};
+    const Texture* read = src;
+    int next = 0;
+    
+    for(unsigned radius: box_x.radius) if(radius != 0)
+    {
+      _launchThreadsWeighted(src->height, src->width,
+        _boxBlurRows, buffers[next], read, radius);
+      read = buffers[next];
+      next ^= 1;
+    }
+    int blocks = (src->width + _tile_size - 1) / _tile_size;
+    for(unsigned radius: box_y.radius) if(radius != 0)
+    {
+      _launchThreadsWeighted(blocks, _tile_size * src->height,
+        _boxBlurColumns, buffers[next], read, radius);
+      read = buffers[next];
+      next ^= 1;
+    }
+    
+    _launchThreadsMasked<_blendBlurred>(mask.to_ulong(), dest, read, src, f);
+    deleteTexture(scratch);
+  }
+}
\ No newline at end of file
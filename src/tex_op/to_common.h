@@ -1,10 +1,22 @@
 #ifndef TEX_OP_COMMON_H_INCLUDED
 #define TEX_OP_COMMON_H_INCLUDED
 
-#include <thread>
+#include <atomic>
+#include <functional>
+
+#include "../thread_pool.h"
+#include "../tex_op.h"
 
 extern int _num_threads;
-extern std::unique_ptr<std::thread[]> _thread_pool;
+extern ThreadPool _thread_pool;
+extern std::atomic<TexOp::Scheduling> _scheduling;
+
+//ranges with less work than this (in texels) are run on the calling thread
+constexpr long _serial_cutoff = 1 << 13;
+//smallest chunk (in texels) handed out with dynamic scheduling
+constexpr long _min_chunk = 1 << 10;
+//side of the square tiles handed out by _launchThreadsTiled
+constexpr int _tile_size = 64;
 
 //helper functions (with bonus crazy metaprogramming)
 
@@ -18,8 +30,24 @@ extern std::unique_ptr<std::thread[]> _thread_pool;
     the function to execute must take two integers as it's final arguments
     these will be supplied the beginning and end indices of the elements for that
     thread
-  _launchThreadsAnd takes another function as it's third argument and executes this
-    function for the last range of elements.
+  _launchThreadsWeighted takes the cost of each element (in texels) as it's second
+    argument, use it when the elements are rows or other larger units of work.
+  _launchThreadsTiled iterates over a width * height texel rectangle split into
+    _tile_size * _tile_size tiles. the function to execute must take four integers
+    as it's final arguments, these will be supplied the rectangle x0, y0, x1, y1
+    (x1 and y1 exclusive) of one tile. use it for kernels reading a neighbourhood
+    around each texel (blur, normal maps) so the rows above and below the tile
+    (the halo) stay in cache while the tile is processed.
+  
+  the ranges are executed by the persistent workers in _thread_pool, the calling
+  thread takes part in the work and returns when all ranges are done. ranges with
+  less work than _serial_cutoff are executed directly on the calling thread.
+  
+  with Scheduling::Static each thread gets one contiguous range. with
+  Scheduling::Dynamic the threads repeatedly claim chunks from a shared counter,
+  starting out large and shrinking as the remaining work shrinks (guided
+  scheduling). all the dispatchers below go through _launchThreadsWeighted and
+  follow the selected mode.
   
   there are helper templates for code generation.
   to use a channel or channel mask as a template argument, allowing compiletime
@@ -35,12 +63,16 @@ extern std::unique_ptr<std::thread[]> _thread_pool;
   
   _launchThreadsMasked: branches for mask (15 options)
     <template<int> class Task>(int mask, Texture* tex, ...)
+  _maskedFunc: returns Task<mask>::func without launching it, nullptr for mask 0
+    <template<int> class Task>(int mask)
   _launchThreadsCh: branches for single channel (4 options)
     <template<int> class Task>(int ch, Texture* tex, ...)
   _launchThreads2Ch: branches for two channels (16 options)
     <template<int, int> class Task>(int ch1, ch2, Texture* tex, ...)
     note: ch1 and ch2 are passed as template arguments in the same order they're
     given.
+  _launchThreadsTiledMasked: same as _launchThreadsMasked, but tiled
+    <template<int> class Task>(int mask, Texture* tex, ...)
   _launchThreadsCh2Masked: branches for channel and mask (60 options)
     <template<int> class Task>(int ch, int mask, Texture* tex, ...)
     note: Task should be a nested template
@@ -52,27 +84,100 @@ extern std::unique_ptr<std::thread[]> _thread_pool;
       handlers should be passed with std::ref
 */
 
+template<class L>
+void _runRange(void* task, int from, int to)
+{
+  (*(L*)task)(from, to);
+}
+
+template<class L>
+class _DynamicRange
+{
+  L& _task;
+  std::atomic<int> _next;
+  int _end;
+  int _min;
+  int _div;
+  
+public:
+  _DynamicRange(L& task, int x, int min_chunk):
+    _task(task), _next(0), _end(x), _min(min_chunk), _div(_num_threads * 2){}
+  
+  void operator()(int, int)
+  {
+    int from = _next.load(std::memory_order_relaxed);
+    for(;;)
+    {
+      int left = _end - from;
+      if(left <= 0)
+        return;
+      int chunk = left / _div;
+      if(chunk < _min) chunk = _min;
+      if(chunk > left) chunk = left;
+      if(_next.compare_exchange_weak(from, from + chunk, std::memory_order_relaxed))
+      {
+        _task(from, from + chunk);
+        from = _next.load(std::memory_order_relaxed);
+      }
+    }
+  }
+};
+
+template<class F, class... T>
+void _launchThreadsWeighted(int x, int weight, F func, T&&... t)
+{
+  if(_num_threads <= 1 || x < 2 || (long)x * weight < _serial_cutoff)
+  {
+    func(std::forward<T>(t)..., 0, x);
+    return;
+  }
+  
+  auto task = std::bind(func, std::ref(t)...,
+    std::placeholders::_1, std::placeholders::_2);
+  if(_scheduling.load(std::memory_order_relaxed) == TexOp::Scheduling::Dynamic)
+  {
+    int min_chunk = _min_chunk / weight;
+    _DynamicRange<decltype(task)> dyn(task, x, min_chunk > 0? min_chunk : 1);
+    ThreadPool::Batch batch(_runRange<decltype(dyn)>, &dyn);
+    _thread_pool.submit(&batch, 0, _num_threads, _num_threads);
+    _thread_pool.wait(&batch);
+  }
+  else
+  {
+    ThreadPool::Batch batch(_runRange<decltype(task)>, &task);
+    _thread_pool.submit(&batch, 0, x, _num_threads);
+    _thread_pool.wait(&batch);
+  }
+}
 template<class F, class... T>
 void _launchThreads(int x, F func, T&&... t)
 {
-  int x_per_thread = x / _num_threads;
-  for(int i = 0; i < _num_threads - 1; ++i)
-    _thread_pool[i] = std::thread(func, std::forward<T>(t)...,
-      x_per_thread * i, x_per_thread * (i + 1));
-  func(std::forward<T>(t)..., x_per_thread * (_num_threads - 1), x);
-  for(int i = 0; i < _num_threads - 1; ++i)
-    _thread_pool[i].join();
+  _launchThreadsWeighted(x, 1, func, std::forward<T>(t)...);
+}
+
+template<class R>
+void _runTiles(R& rect, int width, int height, int from, int to)
+{
+  const int tiles_x = (width + _tile_size - 1) / _tile_size;
+  for(int i = from; i < to; ++i)
+  {
+    int x0 = (i % tiles_x) * _tile_size;
+    int y0 = (i / tiles_x) * _tile_size;
+    int x1 = x0 + _tile_size < width? x0 + _tile_size : width;
+    int y1 = y0 + _tile_size < height? y0 + _tile_size : height;
+    rect(x0, y0, x1, y1);
+  }
 }
-template<class F1, class F2, class... T>
-void _launchThreadsAnd(int x, F1 func1, F2 func2, T&&... t)
+
+template<class F, class... T>
+void _launchThreadsTiled(int width, int height, F func, T&&... t)
 {
-  int x_per_thread = x / _num_threads;
-  for(int i = 0; i < _num_threads - 1; ++i)
-    _thread_pool[i] = std::thread(func1, std::forward<T>(t)...,
-      x_per_thread * i, x_per_thread * (i + 1));
-  func2(std::forward<T>(t)..., x_per_thread * (_num_threads - 1), x);
-  for(int i = 0; i < _num_threads - 1; ++i)
-    _thread_pool[i].join();
+  using namespace std::placeholders;
+  auto rect = std::bind(func, std::ref(t)..., _1, _2, _3, _4);
+  int tiles_x = (width + _tile_size - 1) / _tile_size;
+  int tiles_y = (height + _tile_size - 1) / _tile_size;
+  _launchThreadsWeighted(tiles_x * tiles_y, _tile_size * _tile_size,
+    _runTiles<decltype(rect)>, std::ref(rect), width, height);
 }
 
 template<template<int> class F, class E, class... T>
@@ -101,6 +206,57 @@ void _launchThreadsMasked(
   }
 }
 
+template<template<int> class F>
+auto _maskedFunc(int mask) -> decltype(&F<0xf>::func)
+{
+  switch(mask)
+  {
+  case 0x1: return F<0x1>::func;
+  case 0x2: return F<0x2>::func;
+  case 0x3: return F<0x3>::func;
+  case 0x4: return F<0x4>::func;
+  case 0x5: return F<0x5>::func;
+  case 0x6: return F<0x6>::func;
+  case 0x7: return F<0x7>::func;
+  case 0x8: return F<0x8>::func;
+  case 0x9: return F<0x9>::func;
+  case 0xa: return F<0xa>::func;
+  case 0xb: return F<0xb>::func;
+  case 0xc: return F<0xc>::func;
+  case 0xd: return F<0xd>::func;
+  case 0xe: return F<0xe>::func;
+  case 0xf: return F<0xf>::func;
+  default: return nullptr;
+  }
+}
+
+template<template<int> class F, class E, class... T>
+void _launchThreadsTiledMasked(
+  int mask, E tex, T&&... t)
+{
+  int w = tex->width;
+  int h = tex->height;
+  switch(mask)
+  {
+  case 0x1: _launchThreadsTiled(w, h, F<0x1>::func, tex, std::forward<T>(t)...); break;
+  case 0x2: _launchThreadsTiled(w, h, F<0x2>::func, tex, std::forward<T>(t)...); break;
+  case 0x3: _launchThreadsTiled(w, h, F<0x3>::func, tex, std::forward<T>(t)...); break;
+  case 0x4: _launchThreadsTiled(w, h, F<0x4>::func, tex, std::forward<T>(t)...); break;
+  case 0x5: _launchThreadsTiled(w, h, F<0x5>::func, tex, std::forward<T>(t)...); break;
+  case 0x6: _launchThreadsTiled(w, h, F<0x6>::func, tex, std::forward<T>(t)...); break;
+  case 0x7: _launchThreadsTiled(w, h, F<0x7>::func, tex, std::forward<T>(t)...); break;
+  case 0x8: _launchThreadsTiled(w, h, F<0x8>::func, tex, std::forward<T>(t)...); break;
+  case 0x9: _launchThreadsTiled(w, h, F<0x9>::func, tex, std::forward<T>(t)...); break;
+  case 0xa: _launchThreadsTiled(w, h, F<0xa>::func, tex, std::forward<T>(t)...); break;
+  case 0xb: _launchThreadsTiled(w, h, F<0xb>::func, tex, std::forward<T>(t)...); break;
+  case 0xc: _launchThreadsTiled(w, h, F<0xc>::func, tex, std::forward<T>(t)...); break;
+  case 0xd: _launchThreadsTiled(w, h, F<0xd>::func, tex, std::forward<T>(t)...); break;
+  case 0xe: _launchThreadsTiled(w, h, F<0xe>::func, tex, std::forward<T>(t)...); break;
+  case 0xf: _launchThreadsTiled(w, h, F<0xf>::func, tex, std::forward<T>(t)...); break;
+  default: break;
+  }
+}
+
 template<template<int> class F, class E, class... T>
 void _launchThreadsCh2Masked(
   int ch, int mask, E tex, T&&... t)
@@ -2,6 +2,7 @@
 #include "../tex_op.h"
 
 #include "to_common.h"
+#include "to_simd.h"
 
 constexpr double PI = 3.141592653589793;
 constexpr double PI_halved = 1.5707963267948966;
@@ -37,6 +38,12 @@ public:
   {
     return in < _min? _min : (in > _max? _max : in);
   }
+  bool simd(float* texels, int n, int mask) const
+  {
+    if(!_simd) return false;
+    _simd->clamp(texels, _min, _max, n, mask);
+    return true;
+  }
 };
 
 template<int low_range, int hi_range>
@@ -98,6 +105,12 @@ public:
     else return in < _cutof? 1.: 0.;
     return 0.0;
   }
+  bool simd(float* texels, int n, int mask) const
+  {
+    if(!_simd) return false;
+    _simd->stencil(texels, _cutof, rev, n, mask);
+    return true;
+  }
 };
 
 class DownsampleFunctor
@@ -111,6 +124,19 @@ public:
   }
 };
 
+//functors with a vectorized version provide bool simd(float*, int, int) const
+template<class T>
+inline bool _filterSimd(const T& functor, float* texels, int n, int mask, ...)
+{
+  return false;
+}
+template<class T>
+inline auto _filterSimd(const T& functor, float* texels, int n, int mask, int)
+  -> decltype(functor.simd(texels, n, mask))
+{
+  return functor.simd(texels, n, mask);
+}
+
 template<class T>
 class _filter
 {
@@ -121,6 +147,19 @@ public:
   public:
     static void func(Texture* tex, const T& functor, int from, int to)
     {
+      if(tex->planar())
+      {
+        for(int c = 0; c < 4; ++c) if(mask & (1 << c))
+        {
+          float* plane = tex->plane(c);
+          for(int i = from; i < to; ++i)
+            plane[i] = functor(plane[i]);
+        }
+        return;
+      }
+      if(_filterSimd(functor, _texels(tex, from), to - from, mask, 0))
+        return;
+      
       for(int i = from; i < to; ++i)
       {
         if(mask & 0x1) tex->get(i)[0] = functor(tex->get(i)[0]);
@@ -134,13 +173,33 @@ public:
 
 namespace
 {
+  //texels per block in PointOps::apply, small enough for the block to stay in l1
+  constexpr int _point_ops_block = 1024;
+  
   template<class Functor>
-  inline void _linearFilterHelper(
-    Texture* tex, float f1, float t1, float f2, float t2, std::bitset<4> mask)
+  inline void _recordFilter(
+    std::vector<std::function<void(Texture*, int, int)>>& ops,
+    const Functor& functor,
+    std::bitset<4> mask)
+  {
+    auto func = _maskedFunc<_filter<Functor>::template NextC>(mask.to_ulong());
+    if(func)
+      ops.emplace_back([functor, func](Texture* tex, int from, int to)
+      {
+        func(tex, functor, from, to);
+      });
+  }
+  
+  void _applyPointOps(Texture* tex,
+    const std::vector<std::function<void(Texture*, int, int)>>& ops,
+    int from, int to)
   {
-    Functor lin(f1, t1, f2, t2);
-    _launchThreadsMasked<_filter<Functor>::template NextC>
-      (mask.to_ulong(), tex, std::cref(lin));
+    for(int i = from; i < to; i += _point_ops_block)
+    {
+      int end = std::min(i + _point_ops_block, to);
+      for(auto& op: ops)
+        op(tex, i, end);
+    }
   }
 }
 
@@ -169,6 +228,48 @@ namespace TexOp
   
   void linearFilter(
     Texture* tex, float f1, float t1, float f2, float t2, std::bitset<4> mask)
+  {
+    PointOps ops;
+    ops.linearFilter(f1, t1, f2, t2, mask);
+    ops.apply(tex);
+  }
+  
+  void stencilFilter(Texture* tex, float cutof, bool rev, std::bitset<4> mask)
+  {
+    if(rev)
+    {
+      StencilFunctor<true> fil(cutof);
+      _launchThreadsMasked<_filter<StencilFunctor<true>>::NextC>
+        (mask.to_ulong(), tex, std::cref(fil));
+    }
+    else
+    {
+      StencilFunctor<false> fil(cutof);
+      _launchThreadsMasked<_filter<StencilFunctor<false>>::NextC>
+        (mask.to_ulong(), tex, std::cref(fil));
+    }
+  }
+  
+  void downsampleFilter(Texture* tex, unsigned levels, std::bitset<4> mask)
+  {
+    DownsampleFunctor fil(levels);
+    _launchThreadsMasked<_filter<DownsampleFunctor>::NextC>
+      (mask.to_ulong(), tex, std::cref(fil));
+  }
+  
+  void PointOps::clamp(float min, float max, std::bitset<4> mask)
+  {
+    _recordFilter(_ops, ClampFunctor(min, max), mask);
+  }
+  
+  void PointOps::filter(
+    float co, float li, float sq, float rs, float sm, std::bitset<4> mask)
+  {
+    _recordFilter(_ops, FilterFunctor(co, li, sq, rs, sm), mask);
+  }
+  
+  void PointOps::linearFilter(
+    float f1, float t1, float f2, float t2, std::bitset<4> mask)
   {
     int lo, hi;
     lo = f2 < 0.? 1 : (f2 > 1.? 2 : 0);
@@ -177,55 +278,61 @@ namespace TexOp
     switch(lo + (hi << 2))
     {
     case 0x0:
-      _linearFilterHelper<LinearFunctor<0, 0>>(tex, f1, t1, f2, t2, mask);
+      _recordFilter(_ops, LinearFunctor<0, 0>(f1, t1, f2, t2), mask);
       break;
     case 0x1:
-      _linearFilterHelper<LinearFunctor<-1, 0>>(tex, f1, t1, f2, t2, mask);
+      _recordFilter(_ops, LinearFunctor<-1, 0>(f1, t1, f2, t2), mask);
       break;
     case 0x2:
-      _linearFilterHelper<LinearFunctor<1, 0>>(tex, f1, t1, f2, t2, mask);
+      _recordFilter(_ops, LinearFunctor<1, 0>(f1, t1, f2, t2), mask);
       break;
     case 0x4:
-      _linearFilterHelper<LinearFunctor<0, -1>>(tex, f1, t1, f2, t2, mask);
+      _recordFilter(_ops, LinearFunctor<0, -1>(f1, t1, f2, t2), mask);
       break;
     case 0x5:
-      _linearFilterHelper<LinearFunctor<-1, -1>>(tex, f1, t1, f2, t2, mask);
+      _recordFilter(_ops, LinearFunctor<-1, -1>(f1, t1, f2, t2), mask);
       break;
     case 0x6:
-      _linearFilterHelper<LinearFunctor<1, -1>>(tex, f1, t1, f2, t2, mask);
+      _recordFilter(_ops, LinearFunctor<1, -1>(f1, t1, f2, t2), mask);
       break;
     case 0x8:
-      _linearFilterHelper<LinearFunctor<0, 1>>(tex, f1, t1, f2, t2, mask);
+      _recordFilter(_ops, LinearFunctor<0, 1>(f1, t1, f2, t2), mask);
       break;
     case 0x9:
-      _linearFilterHelper<LinearFunctor<-1, 1>>(tex, f1, t1, f2, t2, mask);
+      _recordFilter(_ops, LinearFunctor<-1, 1>(f1, t1, f2, t2), mask);
       break;
     case 0xa:
-      _linearFilterHelper<LinearFunctor<1, 1>>(tex, f1, t1, f2, t2, mask);
+      _recordFilter(_ops, LinearFunctor<1, 1>(f1, t1, f2, t2), mask);
       break;
     }
   }
   
-  void stencilFilter(Texture* tex, float cutof, bool rev, std::bitset<4> mask)
+  void PointOps::stencilFilter(float cutof, bool rev, std::bitset<4> mask)
   {
     if(rev)
-    {
-      StencilFunctor<true> fil(cutof);
-      _launchThreadsMasked<_filter<StencilFunctor<true>>::NextC>
-        (mask.to_ulong(), tex, std::cref(fil));
-    }
+      _recordFilter(_ops, StencilFunctor<true>(cutof), mask);
     else
-    {
-      StencilFunctor<false> fil(cutof);
-      _launchThreadsMasked<_filter<StencilFunctor<false>>::NextC>
-        (mask.to_ulong(), tex, std::cref(fil));
-    }
+      _recordFilter(_ops, StencilFunctor<false>(cutof), mask);
   }
   
-  void downsampleFilter(Texture* tex, unsigned levels, std::bitset<4> mask)
+  void PointOps::downsampleFilter(unsigned levels, std::bitset<4> mask)
   {
-    DownsampleFunctor fil(levels);
-    _launchThreadsMasked<_filter<DownsampleFunctor>::NextC>
-      (mask.to_ulong(), tex, std::cref(fil));
+    _recordFilter(_ops, DownsampleFunctor(levels), mask);
+  }
+  
+  void PointOps::apply(Texture* tex)
+  {
+    if(_interleaved)
+      setLayout(tex, TexHeader::Layout::Interleaved);
+    if(!_ops.empty())
+      _launchThreads(tex->width * tex->height, _applyPointOps, tex, std::cref(_ops));
+    discard();
+  }
+  
+  void PointOps::discard()
+  {
+    _ops.clear();
+    _interleaved = false;
+    _quantized = 0;
   }
 }
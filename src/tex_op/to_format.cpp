@@ -0,0 +1,122 @@
+#include "../tex_op.h"
+#include "to_common.h"
+#include "to_simd.h"
+#include "to_format.h"
+
+namespace
+{
+  template<class F>
+  void _launchPack(Texture* packed, const Texture* tex)
+  {
+    auto dest = (typename F::Packed*)packed->packedData();
+    _launchThreads(tex->width * tex->height, _pack<F>, dest, tex);
+  }
+
+  template<class F>
+  void _launchUnpack(Texture* tex, const Texture* packed)
+  {
+    auto src = (const typename F::Packed*)packed->packedData();
+    _launchThreads(tex->width * tex->height, _unpack<F>, tex, src);
+  }
+
+  template<class F>
+  void _quantize(Texture* tex, int from, int to)
+  {
+    if(tex->planar())
+    {
+      for(int c = 0; c < 4; ++c)
+      {
+        float* plane = tex->plane(c);
+        for(int i = from; i < to; ++i)
+          plane[i] = F::unpack(F::pack(plane[i]));
+      }
+      return;
+    }
+    float* texels = _texels(tex, from);
+    for(int i = 0; i < (to - from) * 4; ++i)
+      texels[i] = F::unpack(F::pack(texels[i]));
+  }
+}
+
+namespace TexOp
+{
+  Texture* pack(Texture* tex)
+  {
+    if(tex->packed || tex->format == TexHeader::Format::Float)
+      return tex;
+
+    //packed texels are always interleaved, unpack restores the layout
+    auto layout = tex->layout;
+    setLayout(tex, TexHeader::Layout::Interleaved);
+    Texture* packed = makePackedTexture(*tex);
+    packed->layout = layout;
+
+    switch(tex->format)
+    {
+    case TexHeader::Format::Half:
+      _launchPack<_Half>(packed, tex);
+      break;
+    case TexHeader::Format::Unorm16:
+      _launchPack<_Unorm16>(packed, tex);
+      break;
+    case TexHeader::Format::Unorm8:
+      _launchPack<_Unorm8>(packed, tex);
+      break;
+    default:
+      break;
+    }
+
+    deleteTexture(tex);
+    return packed;
+  }
+
+  void PointOps::quantize(TexHeader::Format format)
+  {
+    //quantizing twice in a row changes nothing
+    if(_ops.size() == _quantized)
+      return;
+    switch(format)
+    {
+    case TexHeader::Format::Half:
+      _ops.emplace_back(_quantize<_Half>);
+      break;
+    case TexHeader::Format::Unorm16:
+      _ops.emplace_back(_quantize<_Unorm16>);
+      break;
+    case TexHeader::Format::Unorm8:
+      _ops.emplace_back(_quantize<_Unorm8>);
+      break;
+    default:
+      return;
+    }
+    _quantized = _ops.size();
+  }
+
+  Texture* unpack(Texture* packed)
+  {
+    if(!packed->packed)
+      return packed;
+
+    Texture* tex = makeTexture(packed->width, packed->height);
+    tex->format = packed->format;
+
+    switch(packed->format)
+    {
+    case TexHeader::Format::Half:
+      _launchUnpack<_Half>(tex, packed);
+      break;
+    case TexHeader::Format::Unorm16:
+      _launchUnpack<_Unorm16>(tex, packed);
+      break;
+    case TexHeader::Format::Unorm8:
+      _launchUnpack<_Unorm8>(tex, packed);
+      break;
+    default:
+      break;
+    }
+
+    setLayout(tex, packed->layout);
+    deleteTexture(packed);
+    return tex;
+  }
+}
@@ -0,0 +1,154 @@
+#ifndef TEX_OP_FORMAT_H_INCLUDED
+#define TEX_OP_FORMAT_H_INCLUDED
+
+#include <cmath>
+#include <cstring>
+
+#include "to_simd.h"
+
+/*
+  conversions for the packed formats, also used for the raw 8 bit io. the scalar
+  versions round to nearest even and handle nan, inf and subnormals the same way
+  as the simd kernels, so a texture packs to the same bits whichever path is taken.
+*/
+inline float _clampUnit(float x)
+{
+  x = x > 0.f? x : 0.f;
+  return x < 1.f? x : 1.f;
+}
+
+struct _Half
+{
+  typedef uint16_t Packed;
+
+  static Packed pack(float f)
+  {
+    uint32_t x;
+    memcpy(&x, &f, 4);
+    const uint32_t sign = (x >> 16) & 0x8000;
+    const uint32_t abs = x & 0x7fffffff;
+    //nan stays a (quiet) nan, inf stays inf
+    if(abs >= 0x7f800000)
+      return sign | 0x7c00 | (abs > 0x7f800000? 0x200 | ((abs >> 13) & 0x3ff) : 0);
+    //rounds to inf
+    if(abs >= 0x477ff000)
+      return sign | 0x7c00;
+    //normal half, rebias the exponent and round off the mantissa
+    if(abs >= 0x38800000)
+    {
+      uint32_t m = abs - 0x38000000;
+      m += 0xfff + ((m >> 13) & 1);
+      return sign | (m >> 13);
+    }
+    //subnormal half, adding .5 leaves the value rounded to 2^-24 in the mantissa
+    float a;
+    memcpy(&a, &abs, 4);
+    a += .5f;
+    uint32_t r;
+    memcpy(&r, &a, 4);
+    return sign | (r - 0x3f000000);
+  }
+  static float unpack(Packed h)
+  {
+    const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    const uint32_t e = (h >> 10) & 0x1f;
+    const uint32_t m = h & 0x3ff;
+    uint32_t x;
+    if(e == 0x1f)
+      x = sign | 0x7f800000 | (m << 13) | (m != 0? 0x400000 : 0);
+    else if(e != 0)
+      x = sign | ((e + 112) << 23) | (m << 13);
+    else
+    {
+      float f = (float)m * (1.f / 16777216.f);
+      memcpy(&x, &f, 4);
+      x |= sign;
+    }
+    float f;
+    memcpy(&f, &x, 4);
+    return f;
+  }
+  static void (*packSimd())(Packed*, const float*, int)
+  {
+    return _simd? _simd->packHalf : nullptr;
+  }
+  static void (*unpackSimd())(float*, const Packed*, int)
+  {
+    return _simd? _simd->unpackHalf : nullptr;
+  }
+};
+
+struct _Unorm16
+{
+  typedef uint16_t Packed;
+
+  static Packed pack(float f)
+  {
+    return (Packed)std::lrint(_clampUnit(f) * 65535.f);
+  }
+  static float unpack(Packed v)
+  {
+    return (float)v / 65535.f;
+  }
+  static void (*packSimd())(Packed*, const float*, int)
+  {
+    return _simd? _simd->packUnorm16 : nullptr;
+  }
+  static void (*unpackSimd())(float*, const Packed*, int)
+  {
+    return _simd? _simd->unpackUnorm16 : nullptr;
+  }
+};
+
+struct _Unorm8
+{
+  typedef uint8_t Packed;
+
+  static Packed pack(float f)
+  {
+    return (Packed)std::lrint(_clampUnit(f) * 255.f);
+  }
+  static float unpack(Packed v)
+  {
+    return (float)v / 255.f;
+  }
+  static void (*packSimd())(Packed*, const float*, int)
+  {
+    return _simd? _simd->packUnorm8 : nullptr;
+  }
+  static void (*unpackSimd())(float*, const Packed*, int)
+  {
+    return _simd? _simd->unpackUnorm8 : nullptr;
+  }
+};
+
+//converts texels [from:to), with the simd kernels when available
+template<class F>
+void _pack(typename F::Packed* dest, const Texture* src, int from, int to)
+{
+  const float* src_p = _texels(src, from);
+  dest += from * 4;
+  if(auto simd = F::packSimd())
+  {
+    simd(dest, src_p, to - from);
+    return;
+  }
+  for(int i = 0; i < (to - from) * 4; ++i)
+    dest[i] = F::pack(src_p[i]);
+}
+
+template<class F>
+void _unpack(Texture* dest, const typename F::Packed* src, int from, int to)
+{
+  float* dest_p = _texels(dest, from);
+  src += from * 4;
+  if(auto simd = F::unpackSimd())
+  {
+    simd(dest_p, src, to - from);
+    return;
+  }
+  for(int i = 0; i < (to - from) * 4; ++i)
+    dest_p[i] = F::unpack(src[i]);
+}
+
+#endif
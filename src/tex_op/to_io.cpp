@@ -1,35 +1,33 @@
 
 #include "../tex_op.h"
 #include "to_common.h"
+#include "to_simd.h"
+#include "to_format.h"
 
 namespace
 {
   void _copyc2t(Texture* dest, const uint8_t* src, int from, int to)
   {
-    auto dest_p = dest->data() + from;
-    src += from * 4;
-    for(int i = from; i < to; ++i)
-    {
-      (*dest_p)[0] = (float)src[0] / 255;
-      (*dest_p)[1] = (float)src[1] / 255;
-      (*dest_p)[2] = (float)src[2] / 255;
-      (*dest_p)[3] = (float)src[3] / 255;
-      ++dest_p;
-      src += 4;
-    }
+    _unpack<_Unorm8>(dest, src, from, to);
   }
   void _copyt2c(uint8_t* dest, const Texture* src, int from, int to)
   {
-    auto src_p = src->data() + from;
+    _pack<_Unorm8>(dest, src, from, to);
+  }
+  //for planar textures, gathers the channels of each texel
+  void _copyPlanart2c(uint8_t* dest, const Texture* src, int from, int to)
+  {
+    const float* planes[4];
+    for(int c = 0; c < 4; ++c)
+      planes[c] = src->plane(c);
     dest += from * 4;
     for(int i = from; i < to; ++i)
     {
-      dest[0] = (uint8_t)((*src_p)[0] * 255.5);
-      dest[1] = (uint8_t)((*src_p)[1] * 255.5);
-      dest[2] = (uint8_t)((*src_p)[2] * 255.5);
-      dest[3] = (uint8_t)((*src_p)[3] * 255.5);
+      dest[0] = _Unorm8::pack(planes[0][i]);
+      dest[1] = _Unorm8::pack(planes[1][i]);
+      dest[2] = _Unorm8::pack(planes[2][i]);
+      dest[3] = _Unorm8::pack(planes[3][i]);
       dest += 4;
-      ++src_p;
     }
   }
   
@@ -68,10 +66,10 @@ namespace
       src += from;
       for(int i = from; i < to; ++i)
       {
-        if(mask & 0x1) (*dest_p)[0] = (float)(*src) / 255;
-        if(mask & 0x2) (*dest_p)[1] = (float)(*src) / 255;
-        if(mask & 0x4) (*dest_p)[2] = (float)(*src) / 255;
-        if(mask & 0x8) (*dest_p)[3] = (float)(*src) / 255;
+        if(mask & 0x1) (*dest_p)[0] = _Unorm8::unpack(*src);
+        if(mask & 0x2) (*dest_p)[1] = _Unorm8::unpack(*src);
+        if(mask & 0x4) (*dest_p)[2] = _Unorm8::unpack(*src);
+        if(mask & 0x8) (*dest_p)[3] = _Unorm8::unpack(*src);
         ++dest_p;
         ++src;
       }
@@ -104,7 +102,7 @@ namespace
       dest += from;
       for(int i = from; i < to; ++i)
       {
-        *dest = (uint8_t)((*src_p)[ch] * 255.5);
+        *dest = _Unorm8::pack((*src_p)[ch]);
         ++dest;
         ++src_p;
       }
@@ -146,7 +144,10 @@ namespace TexOp
   void readRawTexture(uint8_t* dest, const Texture* src)
   {
     int elements = src->width * src->height;
-    _launchThreads(elements, _copyt2c, dest, src);
+    if(src->planar())
+      _launchThreads(elements, _copyPlanart2c, dest, src);
+    else
+      _launchThreads(elements, _copyt2c, dest, src);
   }
   void readRawTexture(float* dest, const Texture* src)
   {
@@ -5,29 +5,42 @@
 
 namespace
 {
-  void _makeNormalMap(Texture* tex, double mul, int from, int to)
+  void _makeNormalMap(Texture* tex, double mul, int x0, int y0, int x1, int y1)
   {
-    for(int i = from; i < to; ++i)
+    const int w = tex->width;
+    const int h = tex->height;
+    //channel c of texel i is at planes[c][i * stride], for either layout
+    const int stride = tex->planar()? 1 : 4;
+    float* planes[4];
+    for(int c = 0; c < 4; ++c)
+      planes[c] = tex->planar()? tex->plane(c) : (float*)tex->data() + c;
+    
+    for(int y = y0; y < y1; ++y)
     {
-      int x = i % tex->width;
-      int y = i / tex->width;
-      
-      double x_diff = tex->get((x + tex->width - 1) % tex->width, y)[3];
-      x_diff -= tex->get((x + 1) % tex->width, y)[3];
-      double y_diff = tex->get(x, (y + tex->height - 1) % tex->height)[3];
-      y_diff -= tex->get(x, (y + 1) % tex->height)[3];
-      
-      x_diff *= mul;
-      y_diff *= mul;
-      
-      double len = sqrt(1 + x_diff * x_diff + y_diff * y_diff);
-      x_diff /= len;
-      y_diff /= len;
-      double z_diff = 1. / len;
-      
-      tex->get(i)[2] = (x_diff + 1.) / 2;
-      tex->get(i)[1] = (y_diff + 1.) / 2;
-      tex->get(i)[0] = (z_diff + 1.) / 2;
+      const float* row = planes[3] + y * w * stride;
+      const float* up = planes[3] + (y == 0? h - 1 : y - 1) * w * stride;
+      const float* down = planes[3] + (y == h - 1? 0 : y + 1) * w * stride;
+      for(int x = x0; x < x1; ++x)
+      {
+        int i = (x + y * w) * stride;
+        
+        double x_diff = row[(x == 0? w - 1 : x - 1) * stride];
+        x_diff -= row[(x == w - 1? 0 : x + 1) * stride];
+        double y_diff = up[x * stride];
+        y_diff -= down[x * stride];
+        
+        x_diff *= mul;
+        y_diff *= mul;
+        
+        double len = sqrt(1 + x_diff * x_diff + y_diff * y_diff);
+        x_diff /= len;
+        y_diff /= len;
+        double z_diff = 1. / len;
+        
+        planes[2][i] = (x_diff + 1.) / 2;
+        planes[1][i] = (y_diff + 1.) / 2;
+        planes[0][i] = (z_diff + 1.) / 2;
+      }
     }
   }
 }
@@ -36,6 +49,6 @@ namespace TexOp
 {
   void makeNormalMap(Texture* tex, double mul)
   {
-    _launchThreads(tex->width * tex->height, _makeNormalMap, tex, mul);
+    _launchThreadsTiled(tex->width, tex->height, _makeNormalMap, tex, mul);
   }
 }
\ No newline at end of file
@@ -13,19 +13,21 @@
 
 namespace
 {
+  //the counter is the texel index, so the result does not depend on the threads
   template<int mask>
   class _generateNoise
   {
   public:
-    static void func(Texture* tex, uint32_t* rand, uint32_t rand_max,
-      int from, int to)
+    static void func(Texture* tex, const Rand::Philox& rng, int from, int to)
     {
+      const float rand_max = Rand::Philox::max();
       for(int i = from; i < to; ++i)
       {
-        if(mask & 1) tex->get(i)[0] = (float)rand[i * 4 + 0] / rand_max;
-        if(mask & 2) tex->get(i)[1] = (float)rand[i * 4 + 1] / rand_max;
-        if(mask & 4) tex->get(i)[2] = (float)rand[i * 4 + 2] / rand_max;
-        if(mask & 8) tex->get(i)[3] = (float)rand[i * 4 + 3] / rand_max;
+        auto rand = rng(i);
+        if(mask & 1) tex->get(i)[0] = (float)rand[0] / rand_max;
+        if(mask & 2) tex->get(i)[1] = (float)rand[1] / rand_max;
+        if(mask & 4) tex->get(i)[2] = (float)rand[2] / rand_max;
+        if(mask & 8) tex->get(i)[3] = (float)rand[3] / rand_max;
       }
     }
   };
@@ -34,52 +36,128 @@ namespace
   class _generateWhiteNoise
   {
   public:
-    static void func(Texture* tex, uint32_t* rand, uint32_t rand_max,
-      int from, int to)
+    static void func(Texture* tex, const Rand::Philox& rng, int from, int to)
     {
+      const float rand_max = Rand::Philox::max();
+      if(tex->planar())
+      {
+        for(int i = from; i < to; ++i)
+        {
+          float val = (float)rng(i)[0] / rand_max;
+          for(int c = 0; c < 4; ++c)
+            if(mask & (1 << c)) tex->plane(c)[i] = val;
+        }
+        return;
+      }
+      
       for(int i = from; i < to; ++i)
       {
-        if(mask & 1) tex->get(i)[0] = (float)rand[i] / rand_max;
-        if(mask & 2) tex->get(i)[1] = (float)rand[i] / rand_max;
-        if(mask & 4) tex->get(i)[2] = (float)rand[i] / rand_max;
-        if(mask & 8) tex->get(i)[3] = (float)rand[i] / rand_max;
+        float val = (float)rng(i)[0] / rand_max;
+        if(mask & 1) tex->get(i)[0] = val;
+        if(mask & 2) tex->get(i)[1] = val;
+        if(mask & 4) tex->get(i)[2] = val;
+        if(mask & 8) tex->get(i)[3] = val;
       }
     }
   };
   
+  /*
+    octave u of the turbulence is the top left (width >> u) * (height >> u) block of
+    the source magnified 1 << u times with bilinear filtering, as in
+    Texture::sampleBoxed. the range is walked row by row. for each octave the two
+    source rows are first blended vertically, once per source texel, then each
+    texel blends two neighbouring values of that horizontally. both loops run over
+    contiguous memory and need no divisions.
+    
+    when the size isn't a multiple of 1 << u the last texels map to column w (or
+    row h) of the source, past the block, as in sampleBoxed. only their
+    neighbours wrap around, to column (w + 1) % w.
+  */
+  using _Row = std::vector<Eigen::Array4f, Eigen::aligned_allocator<Eigen::Array4f>>;
+  
+  //(i + 1) % n, for i <= n
+  inline int _next(int i, int n)
+  {
+    return i + 1 < n? i + 1 : (i + 1 - n) % n;
+  }
+  
   template<int mask>
   class _makeTurbulence
   {
   public:
     static void func(Texture* dest, const Texture* src,
-      const std::vector<float>& levels, int from, int to)
+      const std::vector<float>& levels, float l_tot, int from, int to)
     {
-      Eigen::Array4f sample;
-      float l_tot = 0.;
-      for(float f: levels) l_tot += f;
+      const int width = src->width;
+      const int height = src->height;
+      _Row acc(width), cols(width);
       
-      for(int i = from; i < to; ++i)
+      for(int i = from; i < to;)
       {
-        const int x = i % src->width;
-        const int y = i / src->height;
-        sample << 0., 0., 0., 0.;
+        const int y = i / width;
+        const int x0 = i % width;
+        const int x1 = std::min(width, x0 + (to - i));
+        
+        for(int x = x0; x < x1; ++x)
+          acc[x] << 0., 0., 0., 0.;
         
         for(unsigned u = 0; u < levels.size(); ++u)
-          sample += src->sampleBoxed(x, y, u) * levels[u];
-        sample /= l_tot;
+        {
+          const int div = 1 << u;
+          const int w = width >> u;
+          const int h = height >> u;
+          const int fy = y & (div - 1);
+          const int sy0 = y >> u;
+          const int sy1 = _next(sy0, h);
+          const Eigen::Array4f* row0 = &src->get(0, sy0);
+          const Eigen::Array4f* row1 = &src->get(0, sy1);
+          auto blend_rows = [&](int sx)
+          {
+            cols[sx] = row0[sx] * (float)(div - fy) + row1[sx] * (float)fy;
+          };
+          
+          //source columns used by the range, and their right neighbours outside
+          //of it: the one of the last column, and those of columns w - 1 and w,
+          //which wrap around
+          const int sx_first = x0 >> u;
+          const int sx_last = (x1 - 1) >> u;
+          for(int sx = sx_first; sx <= sx_last; ++sx)
+            blend_rows(sx);
+          for(int sx = std::max(sx_first, w - 1); sx <= sx_last; ++sx)
+          {
+            const int next = _next(sx, w);
+            if(next < sx_first || next > sx_last)
+              blend_rows(next);
+          }
+          if(sx_last < w - 1)
+            blend_rows(sx_last + 1);
+          
+          const float scale = levels[u] / (float)(div * div);
+          for(int x = x0; x < x1; ++x)
+          {
+            const int sx0 = x >> u;
+            const int sx1 = _next(sx0, w);
+            const int fx = x & (div - 1);
+            acc[x] += (cols[sx0] * (float)(div - fx) + cols[sx1] * (float)fx) * scale;
+          }
+        }
         
-        if(mask == 0xf)
-          dest->get(i) = sample;
-        else
+        for(int x = x0; x < x1; ++x, ++i)
         {
-          if(mask & 1) dest->get(i)[0] = sample[0];
-          else dest->get(i)[0] = src->get(i)[0];
-          if(mask & 2) dest->get(i)[1] = sample[1];
-          else dest->get(i)[1] = src->get(i)[1];
-          if(mask & 4) dest->get(i)[2] = sample[2];
-          else dest->get(i)[2] = src->get(i)[2];
-          if(mask & 8) dest->get(i)[3] = sample[3];
-          else dest->get(i)[3] = src->get(i)[3];
+          Eigen::Array4f sample = acc[x] / l_tot;
+          if(mask == 0xf)
+            dest->get(i) = sample;
+          else
+          {
+            if(mask & 1) dest->get(i)[0] = sample[0];
+            else dest->get(i)[0] = src->get(i)[0];
+            if(mask & 2) dest->get(i)[1] = sample[1];
+            else dest->get(i)[1] = src->get(i)[1];
+            if(mask & 4) dest->get(i)[2] = sample[2];
+            else dest->get(i)[2] = src->get(i)[2];
+            if(mask & 8) dest->get(i)[3] = sample[3];
+            else dest->get(i)[3] = src->get(i)[3];
+          }
         }
       }
     }
@@ -88,21 +166,14 @@ namespace
 
 namespace TexOp
 {
-  void generateNoise(Texture* tex, int rand_device, std::bitset<4> mask)
+  void generateNoise(Texture* tex, const Rand::Philox& rng, std::bitset<4> mask)
   {
-    std::vector<uint32_t> rand = Rand::producei(
-      rand_device, tex->width * tex->height * 4);
-    uint32_t rand_max = Rand::getMax(rand_device);
-    _launchThreadsMasked<_generateNoise>(mask.to_ulong(), tex, rand.data(), rand_max);
+    _launchThreadsMasked<_generateNoise>(mask.to_ulong(), tex, rng);
   }
   
-  void generateWhiteNoise(Texture* tex, int rand_device, std::bitset<4> mask)
+  void generateWhiteNoise(Texture* tex, const Rand::Philox& rng, std::bitset<4> mask)
   {
-    std::vector<uint32_t> rand = Rand::producei(
-      rand_device, tex->width * tex->height);
-    uint32_t rand_max = Rand::getMax(rand_device);
-    _launchThreadsMasked<_generateWhiteNoise>
-      (mask.to_ulong(), tex, rand.data(), rand_max);
+    _launchThreadsMasked<_generateWhiteNoise>(mask.to_ulong(), tex, rng);
   }
   
   void makeTurbulence(Texture* dest, const Texture* src, int levels,
@@ -111,6 +182,9 @@ namespace TexOp
     std::vector<float> pers(levels);
     float f = 1.;
     std::for_each(__range(pers), [&f, persistance](float& p){p = f; f *= persistance;});
-    _launchThreadsMasked<_makeTurbulence>(mask.to_ulong(), dest, src, std::cref(pers));
+    float l_tot = 0.;
+    for(float p: pers) l_tot += p;
+    _launchThreadsMasked<_makeTurbulence>(
+      mask.to_ulong(), dest, src, std::cref(pers), l_tot);
   }
 }
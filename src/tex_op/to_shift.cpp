@@ -7,12 +7,14 @@ namespace
 {
   void _displaceMap(
     Texture* dest, const Texture* src, const Texture* d_map,
-    float multip, int from, int to)
+    float multip, int x0, int y0, int x1, int y1)
   {
-    for(int i = from; i < to; ++i)
+    for(int y = y0; y < y1; ++y)
+    for(int x = x0; x < x1; ++x)
     {
-      unsigned frag_x = (i % src->width) * 64;
-      unsigned frag_y = (i / src->width) * 64;
+      int i = x + y * src->width;
+      unsigned frag_x = x * 64;
+      unsigned frag_y = y * 64;
       frag_x += (int)((d_map->get(i)[0] * multip) * 64);
       frag_y += (int)((d_map->get(i)[1] * multip) * 64);
       dest->get(i) = src->sampleTrivial<64>
@@ -52,8 +54,7 @@ namespace TexOp
 {
   void displaceMap(Texture* dest, const Texture* src, Texture* dmap, float fac)
   {
-    int elements = dest->width * dest->height;
-    _launchThreads(elements, _displaceMap, dest, src, dmap, fac);
+    _launchThreadsTiled(dest->width, dest->height, _displaceMap, dest, src, dmap, fac);
   }
   
   void sampleMap(Texture* dest, const Texture* src)
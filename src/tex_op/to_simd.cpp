@@ -0,0 +1,629 @@
+#include <cstring>
+
+#include "to_simd.h"
+
+const _SimdKernels* _simd = nullptr;
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+#include <immintrin.h>
+
+//some gcc versions warn about the _mm512_undefined_ps used inside the intrinsics
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+//keep mul and add separate so all instruction sets round the same way
+#pragma GCC optimize("fp-contract=off")
+
+/*
+  note:
+    the kernels are compiled for their instruction set with the target attribute, the
+    rest of the program does not need to be built with -msse4.1 and friends. only
+    the kernels matching the cpu are ever called.
+*/
+#define SIMD_SSE41 __attribute__((target("sse4.1")))
+#define SIMD_AVX2 __attribute__((target("avx2")))
+#define SIMD_F16C __attribute__((target("avx2,f16c")))
+#define SIMD_AVX512 __attribute__((target("avx512f")))
+
+namespace
+{
+  //sse4.1, one texel per vector
+  SIMD_SSE41 inline __m128 _maskSse(int mask)
+  {
+    return _mm_castsi128_ps(_mm_setr_epi32(
+      mask & 1? -1 : 0, mask & 2? -1 : 0, mask & 4? -1 : 0, mask & 8? -1 : 0));
+  }
+
+  SIMD_SSE41 void _copySse(float* dest, const float* src, int n, int mask)
+  {
+    const __m128 m = _maskSse(mask);
+    for(int i = 0; i < n * 4; i += 4)
+    {
+      __m128 d = _mm_loadu_ps(dest + i);
+      __m128 s = _mm_loadu_ps(src + i);
+      _mm_storeu_ps(dest + i, _mm_blendv_ps(d, s, m));
+    }
+  }
+
+  SIMD_SSE41 void _fillSse(float* dest, const float* val, int n, int mask)
+  {
+    const __m128 m = _maskSse(mask);
+    const __m128 v = _mm_loadu_ps(val);
+    for(int i = 0; i < n * 4; i += 4)
+    {
+      __m128 d = _mm_loadu_ps(dest + i);
+      _mm_storeu_ps(dest + i, _mm_blendv_ps(d, v, m));
+    }
+  }
+
+  SIMD_SSE41 void _lerpColorSse(
+    float* dest, const float* val, const float* blend, int n)
+  {
+    const __m128 b = _mm_loadu_ps(blend);
+    const __m128 r = _mm_sub_ps(_mm_set1_ps(1.f), b);
+    const __m128 vb = _mm_mul_ps(_mm_loadu_ps(val), b);
+    for(int i = 0; i < n * 4; i += 4)
+    {
+      __m128 d = _mm_loadu_ps(dest + i);
+      _mm_storeu_ps(dest + i, _mm_add_ps(_mm_mul_ps(d, r), vb));
+    }
+  }
+
+  template<int ch>
+  SIMD_SSE41 void _lerpAlphaSse(
+    float* dest, const float* src, const float* alpha, int n, int mask)
+  {
+    const __m128 m = _maskSse(mask);
+    const __m128 one = _mm_set1_ps(1.f);
+    for(int i = 0; i < n * 4; i += 4)
+    {
+      __m128 a = _mm_loadu_ps(alpha + i);
+      a = _mm_shuffle_ps(a, a, ch * 0x55);
+      __m128 d = _mm_loadu_ps(dest + i);
+      __m128 s = _mm_loadu_ps(src + i);
+      __m128 res = _mm_add_ps(
+        _mm_mul_ps(d, _mm_sub_ps(one, a)), _mm_mul_ps(s, a));
+      _mm_storeu_ps(dest + i, _mm_blendv_ps(d, res, m));
+    }
+  }
+
+  SIMD_SSE41 void _mergeSse(
+    float* dest, const float* src, float blend, int n, int mask)
+  {
+    const __m128 m = _maskSse(mask);
+    const __m128 b = _mm_set1_ps(blend);
+    const __m128 r = _mm_set1_ps(1.f - blend);
+    for(int i = 0; i < n * 4; i += 4)
+    {
+      __m128 d = _mm_loadu_ps(dest + i);
+      __m128 s = _mm_loadu_ps(src + i);
+      __m128 res = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(d, r), s), b);
+      _mm_storeu_ps(dest + i, _mm_blendv_ps(d, res, m));
+    }
+  }
+
+  SIMD_SSE41 void _diffSse(float* dest, const float* src, int n, int mask)
+  {
+    const __m128 m = _maskSse(mask);
+    const __m128 sign = _mm_set1_ps(-0.f);
+    for(int i = 0; i < n * 4; i += 4)
+    {
+      __m128 d = _mm_loadu_ps(dest + i);
+      __m128 s = _mm_loadu_ps(src + i);
+      __m128 res = _mm_andnot_ps(sign, _mm_sub_ps(d, s));
+      _mm_storeu_ps(dest + i, _mm_blendv_ps(d, res, m));
+    }
+  }
+
+  SIMD_SSE41 void _clampSse(float* dest, float min, float max, int n, int mask)
+  {
+    const __m128 m = _maskSse(mask);
+    const __m128 lo = _mm_set1_ps(min);
+    const __m128 hi = _mm_set1_ps(max);
+    for(int i = 0; i < n * 4; i += 4)
+    {
+      __m128 d = _mm_loadu_ps(dest + i);
+      //minps returns it's second operand for nan, same as the scalar version
+      __m128 res = _mm_min_ps(hi, d);
+      res = _mm_blendv_ps(res, lo, _mm_cmplt_ps(d, lo));
+      _mm_storeu_ps(dest + i, _mm_blendv_ps(d, res, m));
+    }
+  }
+
+  SIMD_SSE41 void _stencilSse(float* dest, float cutof, bool rev, int n, int mask)
+  {
+    const __m128 m = _maskSse(mask);
+    const __m128 c = _mm_set1_ps(cutof);
+    const __m128 one = _mm_set1_ps(1.f);
+    for(int i = 0; i < n * 4; i += 4)
+    {
+      __m128 d = _mm_loadu_ps(dest + i);
+      __m128 res = rev?
+        _mm_andnot_ps(_mm_cmpgt_ps(d, c), one) :
+        _mm_and_ps(_mm_cmplt_ps(d, c), one);
+      _mm_storeu_ps(dest + i, _mm_blendv_ps(d, res, m));
+    }
+  }
+
+  //maxps returns it's second operand for nan, so nan ends up as 0
+  SIMD_SSE41 inline __m128i _toUnormSse(__m128 x, __m128 scale)
+  {
+    x = _mm_min_ps(_mm_max_ps(x, _mm_setzero_ps()), _mm_set1_ps(1.f));
+    return _mm_cvtps_epi32(_mm_mul_ps(x, scale));
+  }
+
+  SIMD_SSE41 void _packUnorm16Sse(uint16_t* dest, const float* src, int n)
+  {
+    const __m128 scale = _mm_set1_ps(65535.f);
+    for(int i = 0; i < n * 4; i += 4)
+    {
+      __m128i v = _toUnormSse(_mm_loadu_ps(src + i), scale);
+      _mm_storel_epi64((__m128i*)(dest + i), _mm_packus_epi32(v, v));
+    }
+  }
+
+  SIMD_SSE41 void _unpackUnorm16Sse(float* dest, const uint16_t* src, int n)
+  {
+    const __m128 scale = _mm_set1_ps(65535.f);
+    for(int i = 0; i < n * 4; i += 4)
+    {
+      __m128i v = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+      _mm_storeu_ps(dest + i, _mm_div_ps(_mm_cvtepi32_ps(v), scale));
+    }
+  }
+
+  SIMD_SSE41 void _packUnorm8Sse(uint8_t* dest, const float* src, int n)
+  {
+    const __m128 scale = _mm_set1_ps(255.f);
+    for(int i = 0; i < n * 4; i += 4)
+    {
+      __m128i v = _toUnormSse(_mm_loadu_ps(src + i), scale);
+      v = _mm_packus_epi32(v, v);
+      int32_t texel = _mm_cvtsi128_si32(_mm_packus_epi16(v, v));
+      memcpy(dest + i, &texel, 4);
+    }
+  }
+
+  SIMD_SSE41 void _unpackUnorm8Sse(float* dest, const uint8_t* src, int n)
+  {
+    const __m128 scale = _mm_set1_ps(255.f);
+    for(int i = 0; i < n * 4; i += 4)
+    {
+      int32_t texel;
+      memcpy(&texel, src + i, 4);
+      __m128i v = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(texel));
+      _mm_storeu_ps(dest + i, _mm_div_ps(_mm_cvtepi32_ps(v), scale));
+    }
+  }
+
+  const _SimdKernels _sse41 =
+  {
+    "sse4.1",
+    _copySse,
+    _fillSse,
+    _lerpColorSse,
+    {_lerpAlphaSse<0>, _lerpAlphaSse<1>, _lerpAlphaSse<2>, _lerpAlphaSse<3>},
+    _mergeSse,
+    _diffSse,
+    _clampSse,
+    _stencilSse,
+    nullptr,
+    nullptr,
+    _packUnorm16Sse,
+    _unpackUnorm16Sse,
+    _packUnorm8Sse,
+    _unpackUnorm8Sse
+  };
+
+  //avx2, two texels per vector, an odd texel at the end is left to the sse kernel
+  SIMD_AVX2 inline __m256 _maskAvx2(int mask)
+  {
+    const __m128i m = _mm_setr_epi32(
+      mask & 1? -1 : 0, mask & 2? -1 : 0, mask & 4? -1 : 0, mask & 8? -1 : 0);
+    return _mm256_castsi256_ps(_mm256_broadcastsi128_si256(m));
+  }
+
+  SIMD_AVX2 void _copyAvx2(float* dest, const float* src, int n, int mask)
+  {
+    const __m256 m = _maskAvx2(mask);
+    const int e = n & ~1;
+    for(int i = 0; i < e * 4; i += 8)
+    {
+      __m256 d = _mm256_loadu_ps(dest + i);
+      __m256 s = _mm256_loadu_ps(src + i);
+      _mm256_storeu_ps(dest + i, _mm256_blendv_ps(d, s, m));
+    }
+    if(e < n) _copySse(dest + e * 4, src + e * 4, 1, mask);
+  }
+
+  SIMD_AVX2 void _fillAvx2(float* dest, const float* val, int n, int mask)
+  {
+    const __m256 m = _maskAvx2(mask);
+    const __m256 v = _mm256_broadcast_ps((const __m128*)val);
+    const int e = n & ~1;
+    for(int i = 0; i < e * 4; i += 8)
+    {
+      __m256 d = _mm256_loadu_ps(dest + i);
+      _mm256_storeu_ps(dest + i, _mm256_blendv_ps(d, v, m));
+    }
+    if(e < n) _fillSse(dest + e * 4, val, 1, mask);
+  }
+
+  SIMD_AVX2 void _lerpColorAvx2(
+    float* dest, const float* val, const float* blend, int n)
+  {
+    const __m256 b = _mm256_broadcast_ps((const __m128*)blend);
+    const __m256 r = _mm256_sub_ps(_mm256_set1_ps(1.f), b);
+    const __m256 vb = _mm256_mul_ps(_mm256_broadcast_ps((const __m128*)val), b);
+    const int e = n & ~1;
+    for(int i = 0; i < e * 4; i += 8)
+    {
+      __m256 d = _mm256_loadu_ps(dest + i);
+      _mm256_storeu_ps(dest + i, _mm256_add_ps(_mm256_mul_ps(d, r), vb));
+    }
+    if(e < n) _lerpColorSse(dest + e * 4, val, blend, 1);
+  }
+
+  template<int ch>
+  SIMD_AVX2 void _lerpAlphaAvx2(
+    float* dest, const float* src, const float* alpha, int n, int mask)
+  {
+    const __m256 m = _maskAvx2(mask);
+    const __m256 one = _mm256_set1_ps(1.f);
+    const int e = n & ~1;
+    for(int i = 0; i < e * 4; i += 8)
+    {
+      __m256 a = _mm256_permute_ps(_mm256_loadu_ps(alpha + i), ch * 0x55);
+      __m256 d = _mm256_loadu_ps(dest + i);
+      __m256 s = _mm256_loadu_ps(src + i);
+      __m256 res = _mm256_add_ps(
+        _mm256_mul_ps(d, _mm256_sub_ps(one, a)), _mm256_mul_ps(s, a));
+      _mm256_storeu_ps(dest + i, _mm256_blendv_ps(d, res, m));
+    }
+    if(e < n) _lerpAlphaSse<ch>(dest + e * 4, src + e * 4, alpha + e * 4, 1, mask);
+  }
+
+  SIMD_AVX2 void _mergeAvx2(
+    float* dest, const float* src, float blend, int n, int mask)
+  {
+    const __m256 m = _maskAvx2(mask);
+    const __m256 b = _mm256_set1_ps(blend);
+    const __m256 r = _mm256_set1_ps(1.f - blend);
+    const int e = n & ~1;
+    for(int i = 0; i < e * 4; i += 8)
+    {
+      __m256 d = _mm256_loadu_ps(dest + i);
+      __m256 s = _mm256_loadu_ps(src + i);
+      __m256 res = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(d, r), s), b);
+      _mm256_storeu_ps(dest + i, _mm256_blendv_ps(d, res, m));
+    }
+    if(e < n) _mergeSse(dest + e * 4, src + e * 4, blend, 1, mask);
+  }
+
+  SIMD_AVX2 void _diffAvx2(float* dest, const float* src, int n, int mask)
+  {
+    const __m256 m = _maskAvx2(mask);
+    const __m256 sign = _mm256_set1_ps(-0.f);
+    const int e = n & ~1;
+    for(int i = 0; i < e * 4; i += 8)
+    {
+      __m256 d = _mm256_loadu_ps(dest + i);
+      __m256 s = _mm256_loadu_ps(src + i);
+      __m256 res = _mm256_andnot_ps(sign, _mm256_sub_ps(d, s));
+      _mm256_storeu_ps(dest + i, _mm256_blendv_ps(d, res, m));
+    }
+    if(e < n) _diffSse(dest + e * 4, src + e * 4, 1, mask);
+  }
+
+  SIMD_AVX2 void _clampAvx2(float* dest, float min, float max, int n, int mask)
+  {
+    const __m256 m = _maskAvx2(mask);
+    const __m256 lo = _mm256_set1_ps(min);
+    const __m256 hi = _mm256_set1_ps(max);
+    const int e = n & ~1;
+    for(int i = 0; i < e * 4; i += 8)
+    {
+      __m256 d = _mm256_loadu_ps(dest + i);
+      __m256 res = _mm256_min_ps(hi, d);
+      res = _mm256_blendv_ps(res, lo, _mm256_cmp_ps(d, lo, _CMP_LT_OQ));
+      _mm256_storeu_ps(dest + i, _mm256_blendv_ps(d, res, m));
+    }
+    if(e < n) _clampSse(dest + e * 4, min, max, 1, mask);
+  }
+
+  SIMD_AVX2 void _stencilAvx2(float* dest, float cutof, bool rev, int n, int mask)
+  {
+    const __m256 m = _maskAvx2(mask);
+    const __m256 c = _mm256_set1_ps(cutof);
+    const __m256 one = _mm256_set1_ps(1.f);
+    const int e = n & ~1;
+    for(int i = 0; i < e * 4; i += 8)
+    {
+      __m256 d = _mm256_loadu_ps(dest + i);
+      __m256 res = rev?
+        _mm256_andnot_ps(_mm256_cmp_ps(d, c, _CMP_GT_OQ), one) :
+        _mm256_and_ps(_mm256_cmp_ps(d, c, _CMP_LT_OQ), one);
+      _mm256_storeu_ps(dest + i, _mm256_blendv_ps(d, res, m));
+    }
+    if(e < n) _stencilSse(dest + e * 4, cutof, rev, 1, mask);
+  }
+
+  //the half conversions also need f16c, _initSimd checks for it with avx2
+  SIMD_F16C void _packHalfAvx2(uint16_t* dest, const float* src, int n)
+  {
+    const int e = n & ~1;
+    for(int i = 0; i < e * 4; i += 8)
+    {
+      __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+      _mm_storeu_si128((__m128i*)(dest + i), h);
+    }
+    if(e < n)
+    {
+      __m128i h = _mm_cvtps_ph(_mm_loadu_ps(src + e * 4), _MM_FROUND_TO_NEAREST_INT);
+      _mm_storel_epi64((__m128i*)(dest + e * 4), h);
+    }
+  }
+
+  SIMD_F16C void _unpackHalfAvx2(float* dest, const uint16_t* src, int n)
+  {
+    const int e = n & ~1;
+    for(int i = 0; i < e * 4; i += 8)
+    {
+      __m128i h = _mm_loadu_si128((const __m128i*)(src + i));
+      _mm256_storeu_ps(dest + i, _mm256_cvtph_ps(h));
+    }
+    if(e < n)
+    {
+      __m128i h = _mm_loadl_epi64((const __m128i*)(src + e * 4));
+      _mm_storeu_ps(dest + e * 4, _mm_cvtph_ps(h));
+    }
+  }
+
+  SIMD_AVX2 inline __m256i _toUnormAvx2(__m256 x, __m256 scale)
+  {
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_setzero_ps()), _mm256_set1_ps(1.f));
+    return _mm256_cvtps_epi32(_mm256_mul_ps(x, scale));
+  }
+
+  //packs 4 texels into 16 uint16_t, packus works per 128 bit lane
+  SIMD_AVX2 inline __m256i _packUnorm16x4Avx2(const float* src, __m256 scale)
+  {
+    __m256i lo = _toUnormAvx2(_mm256_loadu_ps(src), scale);
+    __m256i hi = _toUnormAvx2(_mm256_loadu_ps(src + 8), scale);
+    return _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xd8);
+  }
+
+  SIMD_AVX2 void _packUnorm16Avx2(uint16_t* dest, const float* src, int n)
+  {
+    const __m256 scale = _mm256_set1_ps(65535.f);
+    const int e = n & ~3;
+    for(int i = 0; i < e * 4; i += 16)
+      _mm256_storeu_si256((__m256i*)(dest + i), _packUnorm16x4Avx2(src + i, scale));
+    if(e < n) _packUnorm16Sse(dest + e * 4, src + e * 4, n - e);
+  }
+
+  SIMD_AVX2 void _unpackUnorm16Avx2(float* dest, const uint16_t* src, int n)
+  {
+    const __m256 scale = _mm256_set1_ps(65535.f);
+    const int e = n & ~1;
+    for(int i = 0; i < e * 4; i += 8)
+    {
+      __m256i v = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + i)));
+      _mm256_storeu_ps(dest + i, _mm256_div_ps(_mm256_cvtepi32_ps(v), scale));
+    }
+    if(e < n) _unpackUnorm16Sse(dest + e * 4, src + e * 4, 1);
+  }
+
+  SIMD_AVX2 void _packUnorm8Avx2(uint8_t* dest, const float* src, int n)
+  {
+    const __m256 scale = _mm256_set1_ps(255.f);
+    const int e = n & ~3;
+    for(int i = 0; i < e * 4; i += 16)
+    {
+      __m256i v = _packUnorm16x4Avx2(src + i, scale);
+      __m128i b = _mm_packus_epi16(
+        _mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+      _mm_storeu_si128((__m128i*)(dest + i), b);
+    }
+    if(e < n) _packUnorm8Sse(dest + e * 4, src + e * 4, n - e);
+  }
+
+  SIMD_AVX2 void _unpackUnorm8Avx2(float* dest, const uint8_t* src, int n)
+  {
+    const __m256 scale = _mm256_set1_ps(255.f);
+    const int e = n & ~1;
+    for(int i = 0; i < e * 4; i += 8)
+    {
+      __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+      _mm256_storeu_ps(dest + i, _mm256_div_ps(_mm256_cvtepi32_ps(v), scale));
+    }
+    if(e < n) _unpackUnorm8Sse(dest + e * 4, src + e * 4, 1);
+  }
+
+  const _SimdKernels _avx2 =
+  {
+    "avx2",
+    _copyAvx2,
+    _fillAvx2,
+    _lerpColorAvx2,
+    {_lerpAlphaAvx2<0>, _lerpAlphaAvx2<1>, _lerpAlphaAvx2<2>, _lerpAlphaAvx2<3>},
+    _mergeAvx2,
+    _diffAvx2,
+    _clampAvx2,
+    _stencilAvx2,
+    _packHalfAvx2,
+    _unpackHalfAvx2,
+    _packUnorm16Avx2,
+    _unpackUnorm16Avx2,
+    _packUnorm8Avx2,
+    _unpackUnorm8Avx2
+  };
+
+  /*
+    avx512f, four texels per vector. the channel mask is repeated into a write mask,
+    the last vector also masks off the floats past the end of the range, so there
+    is no scalar tail.
+  */
+  inline __mmask16 _maskAvx512(int mask)
+  {
+    return mask | mask << 4 | mask << 8 | mask << 12;
+  }
+  inline __mmask16 _rangeAvx512(int i, int e)
+  {
+    return e - i >= 16? 0xffff : (1 << (e - i)) - 1;
+  }
+
+  SIMD_AVX512 void _copyAvx512(float* dest, const float* src, int n, int mask)
+  {
+    const __mmask16 m = _maskAvx512(mask);
+    for(int i = 0; i < n * 4; i += 16)
+    {
+      const __mmask16 r = _rangeAvx512(i, n * 4);
+      __m512 s = _mm512_maskz_loadu_ps(r, src + i);
+      _mm512_mask_storeu_ps(dest + i, r & m, s);
+    }
+  }
+
+  SIMD_AVX512 void _fillAvx512(float* dest, const float* val, int n, int mask)
+  {
+    const __mmask16 m = _maskAvx512(mask);
+    const __m512 v = _mm512_broadcast_f32x4(_mm_loadu_ps(val));
+    for(int i = 0; i < n * 4; i += 16)
+      _mm512_mask_storeu_ps(dest + i, _rangeAvx512(i, n * 4) & m, v);
+  }
+
+  SIMD_AVX512 void _lerpColorAvx512(
+    float* dest, const float* val, const float* blend, int n)
+  {
+    const __m512 b = _mm512_broadcast_f32x4(_mm_loadu_ps(blend));
+    const __m512 r = _mm512_sub_ps(_mm512_set1_ps(1.f), b);
+    const __m512 vb = _mm512_mul_ps(_mm512_broadcast_f32x4(_mm_loadu_ps(val)), b);
+    for(int i = 0; i < n * 4; i += 16)
+    {
+      const __mmask16 k = _rangeAvx512(i, n * 4);
+      __m512 d = _mm512_maskz_loadu_ps(k, dest + i);
+      _mm512_mask_storeu_ps(dest + i, k, _mm512_add_ps(_mm512_mul_ps(d, r), vb));
+    }
+  }
+
+  template<int ch>
+  SIMD_AVX512 void _lerpAlphaAvx512(
+    float* dest, const float* src, const float* alpha, int n, int mask)
+  {
+    const __mmask16 m = _maskAvx512(mask);
+    const __m512 one = _mm512_set1_ps(1.f);
+    for(int i = 0; i < n * 4; i += 16)
+    {
+      const __mmask16 k = _rangeAvx512(i, n * 4);
+      __m512 a = _mm512_permute_ps(_mm512_maskz_loadu_ps(k, alpha + i), ch * 0x55);
+      __m512 d = _mm512_maskz_loadu_ps(k, dest + i);
+      __m512 s = _mm512_maskz_loadu_ps(k, src + i);
+      __m512 res = _mm512_add_ps(
+        _mm512_mul_ps(d, _mm512_sub_ps(one, a)), _mm512_mul_ps(s, a));
+      _mm512_mask_storeu_ps(dest + i, k & m, res);
+    }
+  }
+
+  SIMD_AVX512 void _mergeAvx512(
+    float* dest, const float* src, float blend, int n, int mask)
+  {
+    const __mmask16 m = _maskAvx512(mask);
+    const __m512 b = _mm512_set1_ps(blend);
+    const __m512 r = _mm512_set1_ps(1.f - blend);
+    for(int i = 0; i < n * 4; i += 16)
+    {
+      const __mmask16 k = _rangeAvx512(i, n * 4) & m;
+      __m512 d = _mm512_maskz_loadu_ps(k, dest + i);
+      __m512 s = _mm512_maskz_loadu_ps(k, src + i);
+      __m512 res = _mm512_mul_ps(_mm512_mul_ps(_mm512_mul_ps(d, r), s), b);
+      _mm512_mask_storeu_ps(dest + i, k, res);
+    }
+  }
+
+  SIMD_AVX512 void _diffAvx512(float* dest, const float* src, int n, int mask)
+  {
+    const __mmask16 m = _maskAvx512(mask);
+    for(int i = 0; i < n * 4; i += 16)
+    {
+      const __mmask16 k = _rangeAvx512(i, n * 4) & m;
+      __m512 d = _mm512_maskz_loadu_ps(k, dest + i);
+      __m512 s = _mm512_maskz_loadu_ps(k, src + i);
+      _mm512_mask_storeu_ps(dest + i, k, _mm512_abs_ps(_mm512_sub_ps(d, s)));
+    }
+  }
+
+  SIMD_AVX512 void _clampAvx512(float* dest, float min, float max, int n, int mask)
+  {
+    const __mmask16 m = _maskAvx512(mask);
+    const __m512 lo = _mm512_set1_ps(min);
+    const __m512 hi = _mm512_set1_ps(max);
+    for(int i = 0; i < n * 4; i += 16)
+    {
+      const __mmask16 k = _rangeAvx512(i, n * 4) & m;
+      __m512 d = _mm512_maskz_loadu_ps(k, dest + i);
+      __m512 res = _mm512_min_ps(hi, d);
+      res = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(d, lo, _CMP_LT_OQ), res, lo);
+      _mm512_mask_storeu_ps(dest + i, k, res);
+    }
+  }
+
+  SIMD_AVX512 void _stencilAvx512(
+    float* dest, float cutof, bool rev, int n, int mask)
+  {
+    const __mmask16 m = _maskAvx512(mask);
+    const __m512 c = _mm512_set1_ps(cutof);
+    const __m512 one = _mm512_set1_ps(1.f);
+    for(int i = 0; i < n * 4; i += 16)
+    {
+      const __mmask16 k = _rangeAvx512(i, n * 4) & m;
+      __m512 d = _mm512_maskz_loadu_ps(k, dest + i);
+      __mmask16 set = rev?
+        (__mmask16)~_mm512_cmp_ps_mask(d, c, _CMP_GT_OQ) :
+        _mm512_cmp_ps_mask(d, c, _CMP_LT_OQ);
+      _mm512_mask_storeu_ps(dest + i, k, _mm512_maskz_mov_ps(set, one));
+    }
+  }
+
+  const _SimdKernels _avx512 =
+  {
+    "avx512f",
+    _copyAvx512,
+    _fillAvx512,
+    _lerpColorAvx512,
+    {_lerpAlphaAvx512<0>, _lerpAlphaAvx512<1>,
+      _lerpAlphaAvx512<2>, _lerpAlphaAvx512<3>},
+    _mergeAvx512,
+    _diffAvx512,
+    _clampAvx512,
+    _stencilAvx512,
+    _packHalfAvx2,
+    _unpackHalfAvx2,
+    _packUnorm16Avx2,
+    _unpackUnorm16Avx2,
+    _packUnorm8Avx2,
+    _unpackUnorm8Avx2
+  };
+}
+
+void _initSimd()
+{
+  __builtin_cpu_init();
+  const bool avx2_f16c =
+    __builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c");
+  if(avx2_f16c && __builtin_cpu_supports("avx512f"))
+    _simd = &_avx512;
+  else if(avx2_f16c)
+    _simd = &_avx2;
+  else if(__builtin_cpu_supports("sse4.1"))
+    _simd = &_sse41;
+  else _simd = nullptr;
+}
+
+#else
+
+void _initSimd()
+{
+  _simd = nullptr;
+}
+
+#endif
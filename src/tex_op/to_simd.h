@@ -0,0 +1,71 @@
+#ifndef TEX_OP_SIMD_H_INCLUDED
+#define TEX_OP_SIMD_H_INCLUDED
+
+#include "../texture.h"
+
+/*
+  vectorized versions of the simple per texel kernels.
+
+  the kernels work on n texels stored as 4 * n consecutive floats, starting at any
+  texel. mask selects the channels to write like everywhere else in TexOp, the other
+  channels are left untouched using blend instructions.
+
+  _initSimd picks the widest instruction set the cpu supports (sse4.1, avx2 or
+  avx512f) and points _simd at it's kernels. the format conversions of the avx2 and
+  avx512f sets are the same avx2 and f16c kernels. _simd is nullptr when none are
+  supported, callers then fall back on their scalar loops.
+
+  note:
+    - all kernels use float arithmetic without fused multiply add, so the results are
+      identical for all instruction sets and the scalar fallbacks.
+    - the conversions round to nearest even like the scalar fallbacks, nan packs to
+      0 in the unorm formats.
+*/
+struct _SimdKernels
+{
+  const char* name;
+
+  //dest = src
+  void (*copy)(float* dest, const float* src, int n, int mask);
+  //dest = val
+  void (*fill)(float* dest, const float* val, int n, int mask);
+  //dest = dest * (1 - blend) + val * blend, blend per channel
+  void (*lerpColor)(float* dest, const float* val, const float* blend, int n);
+  //dest = dest * (1 - a) + src * a, where a is channel ch (index) of alpha
+  void (*lerpAlpha[4])(
+    float* dest, const float* src, const float* alpha, int n, int mask);
+  //dest = dest * (1 - blend) * src * blend
+  void (*merge)(float* dest, const float* src, float blend, int n, int mask);
+  //dest = |dest - src|
+  void (*diff)(float* dest, const float* src, int n, int mask);
+  //dest = dest < min? min : (dest > max? max : dest)
+  void (*clamp)(float* dest, float min, float max, int n, int mask);
+  //dest = dest < cutof? 1 : 0, or rev: dest > cutof? 0 : 1
+  void (*stencil)(float* dest, float cutof, bool rev, int n, int mask);
+  
+  //conversions between floats and the packed formats, n texels, all channels
+  //half floats, nullptr when the cpu lacks f16c
+  void (*packHalf)(uint16_t* dest, const float* src, int n);
+  void (*unpackHalf)(float* dest, const uint16_t* src, int n);
+  //dest = round(clamp(src, 0, 1) * 65535), src = dest / 65535
+  void (*packUnorm16)(uint16_t* dest, const float* src, int n);
+  void (*unpackUnorm16)(float* dest, const uint16_t* src, int n);
+  //dest = round(clamp(src, 0, 1) * 255), src = dest / 255
+  void (*packUnorm8)(uint8_t* dest, const float* src, int n);
+  void (*unpackUnorm8)(float* dest, const uint8_t* src, int n);
+};
+
+extern const _SimdKernels* _simd;
+
+void _initSimd();
+
+inline float* _texels(Texture* tex, int i)
+{
+  return reinterpret_cast<float*>(tex->data() + i);
+}
+inline const float* _texels(const Texture* tex, int i)
+{
+  return reinterpret_cast<const float*>(tex->data() + i);
+}
+
+#endif
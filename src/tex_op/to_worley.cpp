@@ -108,6 +108,7 @@ namespace TexOp
     else range = -range;
     
     //writing operations
-    _launchThreads(tex->height, _writeSDFMap, tex, std::ref(map), std::ref(mask), range);
+    _launchThreadsWeighted(tex->height, tex->width,
+      _writeSDFMap, tex, std::ref(map), std::ref(mask), range);
   }
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define TEXTURE_H_INCLUDED
 
 #include <new>
+#include <cstdint>
 #include <bitset>
 
 #include <eigen3/Eigen/Dense>
@@ -10,8 +11,52 @@
 
 struct alignas(16) TexHeader
 {
+  /*
+    interleaved textures store the 4 channels of a texel next to each other, planar
+    textures store each channel as a contiguous plane of width * height floats. both
+    take the same amount of memory. only a few TexOp functions work on planar
+    textures, the rest expect interleaved textures (see TexOp::setLayout).
+  */
+  enum class Layout: uint8_t
+  {
+    Interleaved,
+    Planar
+  };
+  /*
+    the format a texture is stored in between operations. the TexOp functions only
+    work on unpacked (float) textures, a texture with a reduced precision format is
+    unpacked before it is used and packed again afterwards (see TexOp::pack).
+    Unorm16 and Unorm8 clamp to [0:1].
+  */
+  enum class Format: uint8_t
+  {
+    Float,
+    Half,
+    Unorm16,
+    Unorm8
+  };
+  
   unsigned width;
   unsigned height;
+  Layout layout;
+  Format format;
+  //true while the texels are stored in format rather than as floats
+  bool packed;
+  
+  //bytes per texel
+  static unsigned texelSize(Format format)
+  {
+    switch(format)
+    {
+    case Format::Half:
+    case Format::Unorm16:
+      return 8;
+    case Format::Unorm8:
+      return 4;
+    default:
+      return sizeof(Eigen::Array4f);
+    }
+  }
   
   std::pair<int, int> getDimensions() const
   {
@@ -28,8 +73,11 @@ class Texture: public TexHeader
       objects of this class must never be allocated with new/delete
       use makeTexture or deleteTexture
   */
-  static void* _allocate(int, int);
-  static void _deallocate(void*, int, int);
+  static void* _allocate(int, int, Format = Format::Float);
+  static void _deallocate(void*, int, int, Format = Format::Float);
+  
+  //for packed textures, the texels are left uninitialized
+  explicit Texture(const TexHeader& header): TexHeader(header){}
 
 public:
   Eigen::Array4f* data()
@@ -52,6 +100,16 @@ public:
   {return data()[x + y * width];}
   const Eigen::Array4f& get(int x, int y) const
   {return data()[x + y * width];}
+  float* plane(int ch)
+  {return (float*)data() + ch * width * height;}
+  const float* plane(int ch) const
+  {return (const float*)data() + ch * width * height;}
+  bool planar() const
+  {return layout == Layout::Planar;}
+  void* packedData()
+  {return data();}
+  const void* packedData() const
+  {return data();}
   Eigen::Array4f& getBounded(unsigned x, unsigned y)
   {return data()[(x % width) + (y % height) * width];}
   const Eigen::Array4f& getBounded(unsigned x, unsigned y) const
@@ -167,6 +225,7 @@ public:
   friend Texture* makeTexture(unsigned, unsigned, T...);
   template<class... T>
   friend Texture* makeTexture(Texture&, T...);
+  friend Texture* makePackedTexture(const Texture&);
   friend void deleteTexture(Texture*);
 };
 
@@ -183,5 +242,13 @@ Texture* makeTexture(Texture& other, T... t)
   h = other.height;
   return new(Texture::_allocate(w, h)) Texture(other, t...);
 }
+//a packed texture with the same dimensions, layout and format as other
+inline Texture* makePackedTexture(const Texture& other)
+{
+  TexHeader header = other;
+  header.packed = true;
+  return new(Texture::_allocate(other.width, other.height, other.format))
+    Texture(header);
+}
 
 #endif
@@ -9,264 +9,653 @@
 
 #include "blurfilter.h"
 
-#include "pool_allocator.h"
+#include "result_cache.h"
+#include "task_graph.h"
+#include "tex_arena.h"
 
-#define __range(x) x.begin(),x.end()
-
-constexpr int cexpr_objPerPool(int s)
-{
-  return 256 >> ((s + 1) / 2);
-}
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 
-template<int I> using Pool =
-  PoolAllocator<sizeof(Eigen::Array4f) * ((256 << I) + 1),
-  cexpr_objPerPool(I), 16>;
+#define __range(x) x.begin(),x.end()
 
 void deleteTexture(Texture* tex)
 {
   int w = tex->width;
   int h = tex->height;
+  auto format = tex->packed? tex->format : TexHeader::Format::Float;
   tex->~Texture();
-  Texture::_deallocate(tex, w, h);
+  Texture::_deallocate(tex, w, h, format);
 }
 
-//pools:
 namespace
 {
-  //dispatcher
-  Pool<16>  _pool16;
-  Pool<15>  _pool15;
-  Pool<14>  _pool14;
-  Pool<13>  _pool13;
-  Pool<12>  _pool12;
-  Pool<11>  _pool11;
-  Pool<10>  _pool10;
-  Pool<9>   _pool9;
-  Pool<8>   _pool8;
-  Pool<7>   _pool7;
-  Pool<6>   _pool6;
-  Pool<5>   _pool5;
-  Pool<4>   _pool4;
-  Pool<3>   _pool3;
-  Pool<2>   _pool2;
-  Pool<1>   _pool1;
-  Pool<0>   _pool0;
-  
-  void* _allocate(int magnitude)
-  {
-    void* ptr;
-    switch(magnitude)
-    {
-    case 0:   ptr = _pool0.allocate();  break;
-    case 1:   ptr = _pool1.allocate();  break;
-    case 2:   ptr = _pool2.allocate();  break;
-    case 3:   ptr = _pool3.allocate();  break;
-    case 4:   ptr = _pool4.allocate();  break;
-    case 5:   ptr = _pool5.allocate();  break;
-    case 6:   ptr = _pool6.allocate();  break;
-    case 7:   ptr = _pool7.allocate();  break;
-    case 8:   ptr = _pool8.allocate();  break;
-    case 9:   ptr = _pool9.allocate();  break;
-    case 10:  ptr = _pool10.allocate(); break;
-    case 11:  ptr = _pool11.allocate(); break;
-    case 12:  ptr = _pool12.allocate(); break;
-    case 13:  ptr = _pool13.allocate(); break;
-    case 14:  ptr = _pool14.allocate(); break;
-    case 15:  ptr = _pool15.allocate(); break;
-    case 16:  ptr = _pool16.allocate(); break;
-    default:
-      //*(int*)nullptr = 6;
-      throw tgException("invalid texture size in allocate function");
-    }
-    return ptr;
-  }
-  void _deallocate(int magnitude, void* ptr)
-  {
-    switch(magnitude)
-    {
-    case 0:   _pool0.deallocate(ptr);   break;
-    case 1:   _pool1.deallocate(ptr);   break;
-    case 2:   _pool2.deallocate(ptr);   break;
-    case 3:   _pool3.deallocate(ptr);   break;
-    case 4:   _pool4.deallocate(ptr);   break;
-    case 5:   _pool5.deallocate(ptr);   break;
-    case 6:   _pool6.deallocate(ptr);   break;
-    case 7:   _pool7.deallocate(ptr);   break;
-    case 8:   _pool8.deallocate(ptr);   break;
-    case 9:   _pool9.deallocate(ptr);   break;
-    case 10:  _pool10.deallocate(ptr);  break;
-    case 11:  _pool11.deallocate(ptr);  break;
-    case 12:  _pool12.deallocate(ptr);  break;
-    case 13:  _pool13.deallocate(ptr);  break;
-    case 14:  _pool14.deallocate(ptr);  break;
-    case 15:  _pool15.deallocate(ptr);  break;
-    case 16:  _pool16.deallocate(ptr);  break;
-    default:
-      //*(int*)nullptr = 6;
-      throw tgException("invalid texture size in deallocate function");
+  using TexResPair = std::pair<Texture*, H3DRes>;
+  //stamps are never reused, not even across instances
+  std::atomic<unsigned long> _last_write_stamp(0);
+  
+  /*
+    resampled copies of textures, made when textures of different sizes are
+    combined. entries are keyed by texture handle, write stamp and size. they are
+    dropped when their texture is written, and least recently used first when the
+    cache grows past _resize_cache_limit bytes. a copy in use is taken out of the
+    cache, so concurrent tasks never see it evicted.
+  */
+  constexpr size_t _resize_cache_limit = 128 << 20;
+  
+  class _ResizeCache
+  {
+    struct _Entry
+    {
+      int idx;
+      unsigned long stamp;
+      Texture* tex;
+    };
+    
+    //most recently used first
+    std::list<_Entry> _entries;
+    size_t _size = 0;
+    std::mutex _lock;
+    
+    static size_t _bytes(const Texture* tex)
+    {
+      return sizeof(Eigen::Array4f) * tex->width * tex->height;
+    }
+    
+    void _erase(std::list<_Entry>::iterator it)
+    {
+      _size -= _bytes(it->tex);
+      deleteTexture(it->tex);
+      _entries.erase(it);
+    }
+    
+  public:
+    //removes the copy from the cache, the caller owns it
+    Texture* take(int idx, unsigned long stamp, unsigned width, unsigned height)
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      for(auto it = _entries.begin(); it != _entries.end(); ++it)
+        if(it->idx == idx && it->stamp == stamp &&
+          it->tex->width == width && it->tex->height == height)
+        {
+          Texture* tex = it->tex;
+          _size -= _bytes(tex);
+          _entries.erase(it);
+          return tex;
+        }
+      return nullptr;
+    }
+    
+    //takes ownership of tex, unless it is too large to cache
+    bool insert(int idx, unsigned long stamp, Texture* tex)
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      size_t bytes = _bytes(tex);
+      if(bytes > _resize_cache_limit)
+        return false;
+      while(_size + bytes > _resize_cache_limit)
+        _erase(std::prev(_entries.end()));
+      _entries.push_front({idx, stamp, tex});
+      _size += bytes;
+      return true;
+    }
+    
+    void invalidate(int idx)
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      for(auto it = _entries.begin(); it != _entries.end();)
+      {
+        auto next = std::next(it);
+        if(it->idx == idx)
+          _erase(it);
+        it = next;
+      }
+    }
+    
+    void clear()
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      while(!_entries.empty())
+        _erase(_entries.begin());
+    }
+  };
+  
+}
+
+struct TextureManager::Instance
+{
+  TexResPair* textures;
+  int num_textures = 0;
+  int texture_stepper = 0;
+  int texture_capacity;
+  
+  //stamp of the last write to each texture
+  std::vector<unsigned long> write_stamps;
+  //_last_write_stamp at the last call to packTextures
+  unsigned long pack_stamp = 0;
+  //write stamp of each texture when it's resource was last updated, resources
+  //with older stamps are updated by flushTextures
+  std::vector<unsigned long> upload_stamps;
+  
+  /*
+    pointwise ops are recorded per texture. in deferred mode they pile up until the
+    texture is used by anything else, then the whole chain runs in one pass.
+    otherwise they run as soon as they are recorded.
+  */
+  bool deferred = false;
+  std::vector<TexOp::PointOps> pending_ops;
+  
+  /*
+    in async mode the functions writing to existing textures are added to graph
+    and return right away, with all the textures they touch as resources (even
+    the ones only read from are unpacked and converted to interleaved). functions
+    returning results, creating or destroying textures wait for the textures
+    involved first. the slots of textures in use by tasks are never reallocated,
+    so slot bookkeeping stays on the calling thread.
+  */
+  bool async_mode = false;
+  std::unique_ptr<TaskGraph> graph;
+  
+  _ResizeCache resize_cache;
+  
+  /*
+    cloneTexture and full copies give the new slot the texture of the source, the
+    number of slots holding a texture is kept here while it is more than one. a
+    shared texture is never changed, not even packed or converted to another
+    layout, a slot about to change it takes a copy of it's own first (see _own).
+    slots only ever drop a shared texture, so tasks of different slots may read it
+    concurrently.
+    results of the result cache are held in cached while slots hold them, they are
+    shared with the cache and other instances, so the slots treat them as shared
+    even when only one of them holds it.
+  */
+  std::unordered_map<const Texture*, int> shares;
+  std::unordered_map<const Texture*, std::shared_ptr<Texture>> cached;
+  std::mutex shares_lock;
+  
+  //textures with a reduced precision format which are currently unpacked, or have
+  //pending ops
+  std::vector<int> unpacked;
+  std::mutex unpacked_lock;
+  //textures used by the tasks added since the last packTextures, their tasks only
+  //unpack or replace them when they run
+  std::vector<int> async_used;
+  
+  Instance():
+    textures(new TexResPair[16]),
+    texture_capacity(16),
+    write_stamps(16, 0),
+    upload_stamps(16, 0),
+    pending_ops(16),
+    graph(new TaskGraph(TexOp::threadPool()))
+  {
+    for(int i = 0; i < texture_capacity; ++i)
+    {
+      textures[i].first = nullptr;
+      textures[i].second = 0;
     }
   }
   
-  using TexResPair = std::pair<Texture*, H3DRes>;
-  TexResPair* _textures = nullptr;
-  int _num_textures = 0;
-  int _texture_stepper = 0;
-  int _texture_capacity = 0;
+  ~Instance()
+  {
+    //the destructor waits for the tasks left
+    graph = nullptr;
+    resize_cache.clear();
+    //shared textures are deleted with the last slot holding them, cached ones
+    //with the last handle
+    for(int i = 0; i < texture_capacity; ++i)
+      if(textures[i].first != nullptr && --shares[textures[i].first] <= 0 &&
+        cached.count(textures[i].first) == 0)
+        deleteTexture(textures[i].first);
+    delete[] textures;
+  }
+};
+
+namespace
+{
+  //the instance of the calling thread, tasks run with the instance which added them
+  thread_local TextureManager::Instance* _inst = nullptr;
+  //made current by init on the thread calling it
+  std::unique_ptr<TextureManager::Instance> _default_inst;
+  
+  class _InstanceScope
+  {
+    TextureManager::Instance* _prev;
+    
+  public:
+    _InstanceScope(TextureManager::Instance* inst): _prev(_inst)
+    {
+      _inst = inst;
+    }
+    ~_InstanceScope()
+    {
+      _inst = _prev;
+    }
+  };
+  
+  //call whenever the texels of a texture change
+  inline void _touchTexture(int idx)
+  {
+    _inst->write_stamps[idx] = ++_last_write_stamp;
+    _inst->resize_cache.invalidate(idx);
+  }
+  
+  void _createResource(int, const std::string&);
   
-  void _createResource(int, const char*);
+  //names are never reused, not even across instances
+  std::atomic<int> _num_tex_res(0);
   
-  inline const char* _newTexResName()
+  inline std::string _newTexResName()
   {
-    static int num_tex_res = 0;
-    static char buffer[16];
-    snprintf(buffer, 16, "tex%i", num_tex_res);
-    ++num_tex_res;
-    return buffer;
+    return "tex" + std::to_string(_num_tex_res++);
   }
   
   inline int _findEmptyTexSlot()
   {
-    if(_num_textures == _texture_capacity)
+    if(_inst->num_textures == _inst->texture_capacity)
     {
-      TexResPair* more_textures = new TexResPair[_texture_capacity << 1];
-      memcpy(more_textures, _textures, sizeof(TexResPair) * _texture_capacity);
-      delete[] _textures;
-      _textures = more_textures;
-      _texture_capacity <<= 1;
+      _inst->graph->wait();
+      TexResPair* more_textures = new TexResPair[_inst->texture_capacity << 1];
+      memcpy(more_textures, _inst->textures,
+        sizeof(TexResPair) * _inst->texture_capacity);
+      delete[] _inst->textures;
+      _inst->textures = more_textures;
+      _inst->texture_capacity <<= 1;
+      _inst->write_stamps.resize(_inst->texture_capacity, 0);
+      _inst->pending_ops.resize(_inst->texture_capacity);
+      _inst->upload_stamps.resize(_inst->texture_capacity, 0);
     }
-    while(_textures[_texture_stepper].first != nullptr)
-      _texture_stepper = (_texture_stepper + 1) % _texture_capacity;
-    return _texture_stepper;
+    //slots in use by tasks are never reused
+    int& stepper = _inst->texture_stepper;
+    while(_inst->graph->busy(stepper) || _inst->textures[stepper].first != nullptr)
+      stepper = (stepper + 1) % _inst->texture_capacity;
+    return _inst->texture_stepper;
   }
   inline int _findResourceIdx(H3DRes res)
   {
-    for(int i = 0; i < _texture_capacity; ++i)
-      if(_textures[i].second == res) return i;
+    for(int i = 0; i < _inst->texture_capacity; ++i)
+      if(_inst->textures[i].second == res) return i;
     return -1;
   }
   
-  inline void _validateTextureHandle(int idx)
+  inline void _checkTextureHandle(int idx)
   {
-    if(idx < 0 || idx > _texture_capacity || _textures[idx].first == nullptr)
+    if(idx < 0 || idx > _inst->texture_capacity ||
+      _inst->textures[idx].first == nullptr)
       throw tgException("invalid texture handle: %i", idx);
   }
   
+  //shared textures:
+  inline bool _isShared(const Texture* tex)
+  {
+    std::lock_guard<std::mutex> lock(_inst->shares_lock);
+    return _inst->shares.count(tex) != 0 || _inst->cached.count(tex) != 0;
+  }
+  //the texture of slot idx, to be stored in another slot
+  inline Texture* _shareTexture(int idx)
+  {
+    Texture* tex = _inst->textures[idx].first;
+    std::lock_guard<std::mutex> lock(_inst->shares_lock);
+    auto it = _inst->shares.find(tex);
+    if(it == _inst->shares.end())
+      _inst->shares.emplace(tex, 2);
+    else
+      ++it->second;
+    return tex;
+  }
+  //for a texture a slot no longer holds, it is deleted by the last one
+  void _releaseTexture(Texture* tex)
+  {
+    {
+      std::lock_guard<std::mutex> lock(_inst->shares_lock);
+      auto it = _inst->shares.find(tex);
+      if(it != _inst->shares.end())
+      {
+        if(--it->second == 1)
+          _inst->shares.erase(it);
+        return;
+      }
+      //the cache may still hold it
+      if(_inst->cached.erase(tex) != 0)
+        return;
+    }
+    deleteTexture(tex);
+  }
+  //a result of the result cache, to be stored in a slot
+  Texture* _shareCached(const std::shared_ptr<Texture>& result)
+  {
+    Texture* tex = result.get();
+    std::lock_guard<std::mutex> lock(_inst->shares_lock);
+    if(_inst->cached.emplace(tex, result).second)
+      return tex;
+    auto it = _inst->shares.find(tex);
+    if(it == _inst->shares.end())
+      _inst->shares.emplace(tex, 2);
+    else
+      ++it->second;
+    return tex;
+  }
+  /*
+    call before the texture of slot idx is changed in any way. a shared texture is
+    copied, and released only after the copy is made, so a slot finding it's
+    texture no longer shared never changes it while other slots copy it.
+  */
+  void _own(int idx)
+  {
+    Texture*& tex = _inst->textures[idx].first;
+    if(!_isShared(tex))
+      return;
+    Texture* copy;
+    if(tex->packed)
+    {
+      copy = makePackedTexture(*tex);
+      memcpy(copy->packedData(), tex->packedData(),
+        TexHeader::texelSize(tex->format) * tex->width * tex->height);
+    }
+    else
+      copy = makeTexture(*tex);
+    _releaseTexture(tex);
+    tex = copy;
+  }
+  
+  //packed textures are unpacked on use and packed again by packTextures
+  inline void _unpackTexture(int idx)
+  {
+    Texture*& tex = _inst->textures[idx].first;
+    if(tex->packed)
+    {
+      _own(idx);
+      tex = TexOp::unpack(tex);
+      std::lock_guard<std::mutex> lock(_inst->unpacked_lock);
+      _inst->unpacked.push_back(idx);
+    }
+  }
+  inline void _runPendingOps(int idx)
+  {
+    if(!_inst->pending_ops[idx].empty())
+    {
+      _own(idx);
+      _inst->pending_ops[idx].apply(_inst->textures[idx].first);
+    }
+  }
+  /*
+    packing rounds the texels, touch tells whether they may have changed. the ops
+    pending on a packed texture stay pending, they are followed by the rounding
+    instead, so reading the texture later gives the same texels as running the ops
+    right away.
+  */
+  void _packTexture(int idx, bool touch)
+  {
+    Texture*& tex = _inst->textures[idx].first;
+    if(tex == nullptr || tex->format == TexHeader::Format::Float)
+      return;
+    if(tex->packed)
+    {
+      _inst->pending_ops[idx].quantize(tex->format);
+      return;
+    }
+    _runPendingOps(idx);
+    _own(idx);
+    tex = TexOp::pack(tex);
+    if(touch)
+      _touchTexture(idx);
+  }
+  //for functions only reading from the texture, which handle planar textures
+  inline void _validateSourceHandleAnyLayout(int idx)
+  {
+    _checkTextureHandle(idx);
+    _unpackTexture(idx);
+    _runPendingOps(idx);
+  }
+  //for functions only reading from the texture
+  inline void _validateSourceHandle(int idx)
+  {
+    _validateSourceHandleAnyLayout(idx);
+    if(_inst->textures[idx].first->planar())
+    {
+      _own(idx);
+      TexOp::setLayout(_inst->textures[idx].first, TexHeader::Layout::Interleaved);
+    }
+  }
+  //for functions writing to the texture, which handle planar textures
+  inline void _validateTextureHandleAnyLayout(int idx)
+  {
+    _validateSourceHandleAnyLayout(idx);
+    _own(idx);
+  }
+  //the pointwise functions record into this and end with _endPointOps
+  inline TexOp::PointOps& _pointOps(int idx)
+  {
+    _checkTextureHandle(idx);
+    return _inst->pending_ops[idx];
+  }
+  //for everything else, planar textures are converted back to interleaved
+  inline void _validateTextureHandle(int idx)
+  {
+    _validateTextureHandleAnyLayout(idx);
+    TexOp::setLayout(_inst->textures[idx].first, TexHeader::Layout::Interleaved);
+  }
+  
   int _storeTexture(Texture* tex)
   {
     int idx = _findEmptyTexSlot();
-    _textures[idx].first = tex;
-    _textures[idx].second = 0;
-    ++_num_textures;
+    _inst->textures[idx].first = tex;
+    _inst->textures[idx].second = 0;
+    ++_inst->num_textures;
+    _touchTexture(idx);
+    if(tex->format != TexHeader::Format::Float)
+    {
+      std::lock_guard<std::mutex> lock(_inst->unpacked_lock);
+      _inst->unpacked.push_back(idx);
+    }
     return idx;
   }
+  //tex takes over the format of the texture it replaces. a resource of another
+  //size is replaced by flushTextures
   void _replaceTexture(Texture* tex, int idx)
   {
-    if(_textures[idx].first != nullptr)
-      deleteTexture(_textures[idx].first);
-    _textures[idx].first = tex;
-    if(_textures[idx].second != 0)
+    if(_inst->textures[idx].first != nullptr)
+    {
+      auto format = _inst->textures[idx].first->format;
+      if(tex->format != format)
+      {
+        //a shared tex is never changed, not even it's format
+        if(_isShared(tex))
+        {
+          Texture* copy = makeTexture(*tex);
+          _releaseTexture(tex);
+          tex = copy;
+        }
+        tex->format = format;
+      }
+      _releaseTexture(_inst->textures[idx].first);
+    }
+    _inst->textures[idx].first = tex;
+    _touchTexture(idx);
+    if(tex->format != TexHeader::Format::Float)
     {
-      const char* old_res_name = h3dGetResName(_textures[idx].second);
-      h3dUnloadResource(_textures[idx].second);
-      h3dRemoveResource(_textures[idx].second);
-      _textures[idx].second = 0;
-      const char* new_res_name = _newTexResName();
-      _createResource(idx, new_res_name);
-      H3D::replaceSamplerRes(old_res_name, new_res_name);
+      std::lock_guard<std::mutex> lock(_inst->unpacked_lock);
+      _inst->unpacked.push_back(idx);
     }
   }
-  void _deleteTexture(int idx)
-  {
-    _validateTextureHandle(idx);
-    deleteTexture(_textures[idx].first);
-    _textures[idx].first = nullptr;
-    if(_textures[idx].second != 0)
+  
+  /*
+    the result cache is looked up with the name of the operation, the parameters
+    params adds to the key, and the texels of texture idx. _cachedResult is for
+    operations making a new texture, _cachedInplace for those writing to idx.
+    results are shared with the cache, they are copied by the first slot to change
+    them (see _own).
+  */
+  template<class P, class F>
+  Texture* _cachedResult(const char* name, int idx, P params, F op)
+  {
+    if(!ResultCache::enabled())
+      return op();
+    ResultCache::Hasher hasher(name);
+    params(hasher);
+    hasher.add(_inst->textures[idx].first);
+    ResultCache::Key key = hasher.key();
+    std::shared_ptr<Texture> result = ResultCache::find(key);
+    if(result == nullptr)
+      result = ResultCache::insert(key, op());
+    return _shareCached(result);
+  }
+  template<class P, class F>
+  void _cachedInplace(const char* name, int idx, P params, F op)
+  {
+    if(!ResultCache::enabled())
     {
-      h3dUnloadResource(_textures[idx].second);
-      h3dRemoveResource(_textures[idx].second);
-      _textures[idx].second = 0;
+      op();
+      return;
+    }
+    ResultCache::Hasher hasher(name);
+    params(hasher);
+    hasher.add(_inst->textures[idx].first);
+    ResultCache::Key key = hasher.key();
+    if(std::shared_ptr<Texture> result = ResultCache::find(key))
+      _replaceTexture(_shareCached(result), idx);
+    else
+    {
+      op();
+      //the slot keeps the texture, now shared with the cache
+      _shareCached(ResultCache::insert(key, _inst->textures[idx].first));
     }
-    --_num_textures;
   }
-  Texture* _stealTexture(int idx)
+  
+  void _deleteTexture(int idx)
   {
-    _validateTextureHandle(idx);
-    Texture* tex = _textures[idx].first;
-    _textures[idx].first = nullptr;
-    return tex;
+    _checkTextureHandle(idx);
+    _releaseTexture(_inst->textures[idx].first);
+    _inst->textures[idx].first = nullptr;
+    _inst->pending_ops[idx].discard();
+    _touchTexture(idx);
+    if(_inst->textures[idx].second != 0)
+    {
+      h3dUnloadResource(_inst->textures[idx].second);
+      h3dRemoveResource(_inst->textures[idx].second);
+      _inst->textures[idx].second = 0;
+    }
+    --_inst->num_textures;
   }
-  
   void _updateResource(int idx)
   {
-    //note: this function provides no checking for float values outside of
-    //range [0:1]
-    char* stream = (char*)h3dMapResStream(
-      _textures[idx].second, H3DTexRes::ImageElem, 0,
+    //values outside of range [0:1] are clamped
+    _unpackTexture(idx);
+    _runPendingOps(idx);
+    uint8_t* stream = (uint8_t*)h3dMapResStream(
+      _inst->textures[idx].second, H3DTexRes::ImageElem, 0,
       H3DTexRes::ImgPixelStream, false, true);
     
-    int size = _textures[idx].first->width * _textures[idx].first->height;
-    
-    auto data = _textures[idx].first->data();
+    TexOp::readRawTexture(stream, _inst->textures[idx].first);
     
-    for(int i = 0; i < size; ++i)
+    h3dUnmapResStream(_inst->textures[idx].second);
+    _inst->upload_stamps[idx] = _inst->write_stamps[idx];
+  }
+  
+  //every function writing to a texture ends with this, the resource is updated
+  //by the next flushTextures
+  inline void _updateResourceMaybe(int idx)
+  {
+    _touchTexture(idx);
+  }
+  inline void _endPointOps(int idx)
+  {
+    if(!_inst->deferred)
+      _validateTextureHandleAnyLayout(idx);
+    else if(_inst->textures[idx].first->format != TexHeader::Format::Float)
     {
-      stream[0] = (char)((*data)[0] * 255.5);
-      stream[1] = (char)((*data)[1] * 255.5);
-      stream[2] = (char)((*data)[2] * 255.5);
-      stream[3] = (char)((*data)[3] * 255.5);
-      stream += 4;
-      ++data;
+      std::lock_guard<std::mutex> lock(_inst->unpacked_lock);
+      _inst->unpacked.push_back(idx);
     }
-    
-    h3dUnmapResStream(_textures[idx].second);
+    _updateResourceMaybe(idx);
   }
   
-  inline void _updateResourceMaybe(int idx)
+  //a texture in use by a task is checked without waiting for it
+  inline void _checkAsyncHandle(int idx)
   {
-    if(_textures[idx].second != 0)
-      _updateResource(idx);
+    if(idx < 0 || idx >= _inst->texture_capacity ||
+      (!_inst->graph->busy(idx) && _inst->textures[idx].first == nullptr))
+      throw tgException("invalid texture handle: %i", idx);
+  }
+  //runs func, in async mode it is added to the graph with the textures it touches
+  template<class F>
+  void _async(const std::vector<int>& textures, F func)
+  {
+    if(!_inst->async_mode || TaskGraph::inTask())
+    {
+      func();
+      return;
+    }
+    for(int idx: textures)
+      _checkAsyncHandle(idx);
+    _inst->async_used.insert(_inst->async_used.end(), textures.begin(), textures.end());
+    TextureManager::Instance* inst = _inst;
+    _inst->graph->add([inst, func]() mutable
+    {
+      _InstanceScope scope(inst);
+      func();
+    }, textures);
+  }
+  //waits for the tasks using the texture, errors of any task are thrown here
+  inline void _await(int idx)
+  {
+    if(!TaskGraph::inTask())
+      _inst->graph->wait(idx);
   }
   
-  void _createResource(int idx, const char* res_name)
+  void _createResource(int idx, const std::string& res_name)
   {
-    static int tex_num = 0;
-    ++tex_num;
-    if(_textures[idx].second != 0)
+    if(_inst->textures[idx].second != 0)
     {
-      h3dUnloadResource(_textures[idx].second);
-      h3dRemoveResource(_textures[idx].second);
+      h3dUnloadResource(_inst->textures[idx].second);
+      h3dRemoveResource(_inst->textures[idx].second);
     }
-    H3DRes tex = h3dCreateTexture(res_name,
-      _textures[idx].first->width, _textures[idx].first->height,
+    H3DRes tex = h3dCreateTexture(res_name.c_str(),
+      _inst->textures[idx].first->width, _inst->textures[idx].first->height,
       H3DFormats::TEX_BGRA8, H3DResFlags::NoTexMipmaps);
     
-    _textures[idx].second = tex;
+    _inst->textures[idx].second = tex;
     
     _updateResource(idx);
   }
   
+  void _recreateResource(int idx)
+  {
+    //the name is copied, it goes with the resource
+    std::string old_res_name = h3dGetResName(_inst->textures[idx].second);
+    h3dUnloadResource(_inst->textures[idx].second);
+    h3dRemoveResource(_inst->textures[idx].second);
+    _inst->textures[idx].second = 0;
+    std::string new_res_name = _newTexResName();
+    _createResource(idx, new_res_name);
+    H3D::replaceSamplerRes(old_res_name.c_str(), new_res_name.c_str());
+  }
+  
   inline bool _areTexturesSameSize(int tex1, int tex2)
   {
     return
-      _textures[tex1].first->width == _textures[tex2].first->width &&
-      _textures[tex1].first->height == _textures[tex2].first->height;
+      _inst->textures[tex1].first->width == _inst->textures[tex2].first->width &&
+      _inst->textures[tex1].first->height == _inst->textures[tex2].first->height;
   }
 }
 
-void* Texture::_allocate(int w, int h)
+//packed textures take 1/2 or 1/4 the memory of float textures
+inline size_t _textureBytes(int w, int h, TexHeader::Format format)
+{
+  return sizeof(Eigen::Array4f) + (size_t)TexHeader::texelSize(format) * w * h;
+}
+
+void* Texture::_allocate(int w, int h, Format format)
 {
-  int magnitude = 0;
-  for(int i = 16; i < w; i <<= 1, ++magnitude);
-  for(int i = 16; i < h; i <<= 1, ++magnitude);
-  return ::_allocate(magnitude);
+  return TexArena::allocate(_textureBytes(w, h, format), (size_t)w * h);
 }
 
-void Texture::_deallocate(void* ptr, int w, int h)
+void Texture::_deallocate(void* ptr, int w, int h, Format format)
 {
-  int magnitude = 0;
-  for(int i = 16; i < w; i <<= 1, ++magnitude);
-  for(int i = 16; i < h; i <<= 1, ++magnitude);
-  ::_deallocate(magnitude, ptr);
+  TexArena::deallocate(ptr, _textureBytes(w, h, format));
 }
 
 Texture::Texture(unsigned w, unsigned h, H3DRes res): TexHeader{w, h}
@@ -275,18 +664,13 @@ Texture::Texture(unsigned w, unsigned h, H3DRes res): TexHeader{w, h}
   const uint8_t* stream = (const uint8_t*)h3dMapResStream(
     res, H3DTexRes::ImageElem, 0, H3DTexRes::ImgPixelStream, true, false);
   
-  for(unsigned i = 0; i < w * h; ++i)
-  {
-    data()[i][0] = (float)stream[i * 4] / 255.5;
-    data()[i][1] = (float)stream[i * 4 + 1] / 255.5;
-    data()[i][2] = (float)stream[i * 4 + 2] / 255.5;
-    data()[i][3] = (float)stream[i * 4 + 3] / 255.5;
-  }
+  TexOp::writeRawTexture(this, stream);
   
   h3dUnmapResStream(res);
 }
 
-Texture::Texture(Texture& other): TexHeader{other.width, other.height}
+Texture::Texture(Texture& other):
+  TexHeader{other.width, other.height, other.layout, other.format}
 {
   TexOp::copyTexture(this, &other, 0xf);
 }
@@ -294,30 +678,45 @@ Texture::Texture(Texture& other): TexHeader{other.width, other.height}
 namespace TextureManager
 {
   //helper classes
+  /*
+    tex1 resampled to the size of tex2. unless cached is false, the copy is taken
+    from the resize cache, and handed (back) to the cache when this object goes away,
+    so it is never evicted while in use. a cached copy must not be written to.
+  */
   class LinearInterpTexture
   {
+    int _src;
+    unsigned long _stamp;
+    bool _cached;
+    
   public:
     Texture* handle;
     bool did_interp;
-    LinearInterpTexture(int tex1, int tex2)
+    LinearInterpTexture(int tex1, int tex2, bool cached = true):
+      _src(tex1), _stamp(_inst->write_stamps[tex1]), _cached(cached)
     {
-      if(!_areTexturesSameSize(tex1, tex2))
+      did_interp = false;
+      if(_areTexturesSameSize(tex1, tex2))
       {
-        did_interp = true;
-        handle = makeTexture(*_textures[tex1].first);
-        handle = TexOp::resizeTexture(handle,
-          _textures[tex2].first->width,
-          _textures[tex2].first->height);
+        handle = _inst->textures[tex1].first;
+        return;
       }
-      else
+      
+      const unsigned width = _inst->textures[tex2].first->width;
+      const unsigned height = _inst->textures[tex2].first->height;
+      did_interp = true;
+      handle = cached? _inst->resize_cache.take(tex1, _stamp, width, height) : nullptr;
+      if(handle == nullptr)
       {
-        did_interp = false;
-        handle = _textures[tex1].first;
+        handle = TexOp::resizeTexture(_inst->textures[tex1].first, width, height);
       }
     }
     ~LinearInterpTexture()
     {
-      if(did_interp)
+      if(!did_interp)
+        return;
+      if(!_cached || _inst->write_stamps[_src] != _stamp ||
+        !_inst->resize_cache.insert(_src, _stamp, handle))
         deleteTexture(handle);
     }
     operator Texture*()
@@ -330,22 +729,39 @@ namespace TextureManager
 
   void init()
   {
-    _textures = new TexResPair[16];
-    _texture_capacity = 16;
-    for(int i = 0; i < _texture_capacity; ++i)
-    {
-      _textures[i].first = nullptr;
-      _textures[i].second = 0;
-    }
-    
     TexOp::init();
+    _default_inst.reset(new Instance);
+    _inst = _default_inst.get();
   }
   
   void deinit()
   {
-    delete[] _textures;
+    if(_inst == _default_inst.get())
+      _inst = nullptr;
+    _default_inst = nullptr;
+    //the cached results go back to the arena while it's still there
+    ResultCache::disable();
     TexOp::deinit();
   }
+  
+  Instance* createInstance()
+  {
+    return new Instance;
+  }
+  
+  void destroyInstance(Instance* inst)
+  {
+    if(_inst == inst)
+      _inst = nullptr;
+    delete inst;
+  }
+  
+  Instance* setInstance(Instance* inst)
+  {
+    Instance* prev = _inst;
+    _inst = inst;
+    return prev;
+  }
 
   int addTexture(H3DRes res)
   {
@@ -353,17 +769,21 @@ namespace TextureManager
     int tex_h = h3dGetResParamI(res, H3DTexRes::ImageElem, 0, H3DTexRes::ImgHeightI);
     
     int idx = _storeTexture(makeTexture(tex_w, tex_h, res));
-    _textures[idx].second = res;
+    _inst->textures[idx].second = res;
+    _inst->upload_stamps[idx] = _inst->write_stamps[idx];
     return idx;
   }
   
-  int addTexture(int w, int h)
+  int addTexture(int w, int h, TexHeader::Format format)
   {
-    return _storeTexture(makeTexture(w, h));
+    Texture* tex = makeTexture(w, h);
+    tex->format = format;
+    return _storeTexture(tex);
   }
   
   void destroyTexture(int tex)
   {
+    _await(tex);
     _deleteTexture(tex);
   }
   
@@ -371,195 +791,346 @@ namespace TextureManager
   {
     while(beg != end)
     {
+      _await(*beg);
       _deleteTexture(*beg);
       ++beg;
     }
   }
   
+  //the clone shares the texture, which is copied by the first of them to change it
   int cloneTexture(int tex)
   {
-    _validateTextureHandle(tex);
-    Texture* new_tex = makeTexture(*_textures[tex].first);
-    return _storeTexture(new_tex);
+    _await(tex);
+    _checkTextureHandle(tex);
+    //packed textures are shared as they are
+    if(!_inst->pending_ops[tex].empty())
+      _validateSourceHandleAnyLayout(tex);
+    return _storeTexture(_shareTexture(tex));
   }
   
   void copyTexture(int dest, int src, std::bitset<4> mask)
   {
-    _validateTextureHandle(dest);
-    _validateTextureHandle(src);
-    
-    if(mask.all())
-    {
-      Texture* dest_t = _textures[dest].first;
-      Texture* src_t = _textures[src].first;
-      Texture* new_tex = makeTexture(*src_t);
-      if(dest_t->width != src_t->width || dest_t->height != src_t->height)
-        new_tex = TexOp::resizeTexture(new_tex, dest_t->width, dest_t->height);
-      _replaceTexture(new_tex, dest);
-    }
-    else
+    _async({dest, src}, [=]()
     {
-      LinearInterpTexture src_c(src, dest);
-      TexOp::copyTexture(_textures[dest].first, src_c, mask);
-      _updateResourceMaybe(dest);
-    }
+      if(mask.all())
+      {
+        _checkTextureHandle(dest);
+        if(dest == src)
+          return;
+        _validateSourceHandle(src);
+        //the texels of dest are dropped, so are it's pending ops
+        _inst->pending_ops[dest].discard();
+        Texture* dest_t = _inst->textures[dest].first;
+        Texture* src_t = _inst->textures[src].first;
+        Texture* new_tex;
+        if(dest_t->width != src_t->width || dest_t->height != src_t->height)
+          new_tex = TexOp::resizeTexture(src_t, dest_t->width, dest_t->height);
+        else if(dest_t->format == src_t->format)
+          new_tex = _shareTexture(src);
+        else
+          new_tex = makeTexture(*src_t);
+        _replaceTexture(new_tex, dest);
+      }
+      else
+      {
+        _validateTextureHandle(dest);
+        _validateSourceHandle(src);
+        LinearInterpTexture src_c(src, dest);
+        TexOp::copyTexture(_inst->textures[dest].first, src_c, mask);
+        _updateResourceMaybe(dest);
+      }
+    });
   }
   
   void swapTextures(int tex1, int tex2, std::bitset<4> mask)
   {
-    _validateTextureHandle(tex1);
-    _validateTextureHandle(tex2);
-    
-    if(mask.all())
-    {
-      auto temp = _textures[tex1].first;
-      _textures[tex1].first = _textures[tex2].first;
-      _textures[tex2].first = temp;
-    }
-    else
+    _async({tex1, tex2}, [=]()
     {
-      TexOp::swapChannels(_textures[tex1].first, _textures[tex2].first, mask);
-    }
-    _updateResourceMaybe(tex1);
-    _updateResourceMaybe(tex2);
+      if(mask.all())
+      {
+        _validateSourceHandle(tex1);
+        _validateSourceHandle(tex2);
+        auto temp = _inst->textures[tex1].first;
+        _inst->textures[tex1].first = _inst->textures[tex2].first;
+        _inst->textures[tex2].first = temp;
+      }
+      else
+      {
+        _validateTextureHandle(tex1);
+        _validateTextureHandle(tex2);
+        TexOp::swapChannels(
+          _inst->textures[tex1].first, _inst->textures[tex2].first, mask);
+      }
+      _updateResourceMaybe(tex1);
+      _updateResourceMaybe(tex2);
+    });
   }
   
-  void resizeTexture(int tex, unsigned width, unsigned height)
+  void resizeTexture(int tex, unsigned width, unsigned height,
+    TexOp::ResizeFilter filter)
   {
-    _validateTextureHandle(tex);
-    if(_textures[tex].first->width == width && _textures[tex].first->height == height)
-      return;
+    _async({tex}, [=]()
+    {
+      _validateSourceHandle(tex);
+      if(_inst->textures[tex].first->width == width &&
+        _inst->textures[tex].first->height == height)
+        return;
     
-    Texture* new_tex = TexOp::resizeTexture(_stealTexture(tex), width, height);
-    _replaceTexture(new_tex, tex);
+      //the slot keeps it's texture if resizing fails
+      _replaceTexture(TexOp::resizeTexture(
+        _inst->textures[tex].first, width, height, filter), tex);
+    });
   }
   
   decltype(TexHeader().getDimensions()) getTextureDimensions(int tex)
   {
-    _validateTextureHandle(tex);
-    return _textures[tex].first->getDimensions();
+    _await(tex);
+    _checkTextureHandle(tex);
+    return _inst->textures[tex].first->getDimensions();
+  }
+  
+  void setTextureLayout(int tex, TexHeader::Layout layout)
+  {
+    _async({tex}, [=]()
+    {
+      _validateSourceHandleAnyLayout(tex);
+      if(_inst->textures[tex].first->layout != layout)
+      {
+        _own(tex);
+        TexOp::setLayout(_inst->textures[tex].first, layout);
+      }
+    });
   }
   
   void removeResource(H3DRes res)
   {
     int idx = _findResourceIdx(res);
     if(idx >= 0)
-      _textures[idx].second = 0;
+      _inst->textures[idx].second = 0;
   }
   
   std::vector<int> listTextures()
   {
     std::vector<int> textures;
-    for(int i = 0; i < _texture_capacity; ++i)
-    if(_textures[i].first != nullptr)
+    for(int i = 0; i < _inst->texture_capacity; ++i)
+    if(_inst->graph->busy(i) || _inst->textures[i].first != nullptr)
       textures.push_back(i);
     return textures;
   }
   
+  void packTextures()
+  {
+    //the lock is not held while packing, tasks may run on this thread meanwhile
+    std::vector<int> unpacked;
+    {
+      std::lock_guard<std::mutex> lock(_inst->unpacked_lock);
+      unpacked.swap(_inst->unpacked);
+    }
+    unpacked.insert(unpacked.end(), _inst->async_used.begin(), _inst->async_used.end());
+    std::sort(unpacked.begin(), unpacked.end());
+    unpacked.erase(std::unique(unpacked.begin(), unpacked.end()), unpacked.end());
+    for(int idx: unpacked)
+      if(_inst->graph->busy(idx))
+      {
+        //packed after the tasks added so far, as if they had run already. the
+        //format is only known once they have
+        _async({idx}, [idx]()
+        {
+          _packTexture(idx, true);
+        });
+      }
+      else
+        _packTexture(idx, _inst->write_stamps[idx] > _inst->pack_stamp);
+    //after the loop, the packing tasks are not packed again
+    _inst->async_used.clear();
+    _inst->pack_stamp = _last_write_stamp;
+  }
+  
+  void setDeferred(bool deferred)
+  {
+    _inst->graph->wait();
+    _inst->deferred = deferred;
+    if(!deferred)
+      for(int idx = 0; idx < _inst->texture_capacity; ++idx)
+        if(_inst->textures[idx].first != nullptr)
+        {
+          _unpackTexture(idx);
+          _runPendingOps(idx);
+        }
+  }
+  
+  void setAsync(bool async)
+  {
+    _inst->graph->wait();
+    _inst->async_mode = async;
+  }
+  
+  void flushTextures()
+  {
+    for(int idx = 0; idx < _inst->texture_capacity; ++idx)
+      if(_inst->textures[idx].second != 0)
+      {
+        _await(idx);
+        if(_inst->textures[idx].first == nullptr ||
+          _inst->upload_stamps[idx] == _inst->write_stamps[idx])
+          continue;
+        //resources can't change size
+        if(h3dGetResParamI(_inst->textures[idx].second,
+            H3DTexRes::ImageElem, 0, H3DTexRes::ImgWidthI) !=
+            (int)_inst->textures[idx].first->width ||
+          h3dGetResParamI(_inst->textures[idx].second,
+            H3DTexRes::ImageElem, 0, H3DTexRes::ImgHeightI) !=
+            (int)_inst->textures[idx].first->height)
+          _recreateResource(idx);
+        else
+          _updateResource(idx);
+      }
+    //updating unpacks the textures with a reduced precision format
+    packTextures();
+  }
+  
+  TexArena::Stats getMemoryStats()
+  {
+    return TexArena::stats();
+  }
+  
+  void setMemoryLimit(size_t limit)
+  {
+    TexArena::setLimit(limit);
+  }
+  
+  void trimMemory()
+  {
+    TexArena::trim();
+  }
+  
+  void setHugePages(bool huge_pages)
+  {
+    TexArena::setHugePages(huge_pages);
+    TexArena::setFirstTouch(huge_pages? TexOp::firstTouch : nullptr);
+    TexOp::threadPool().pinWorkers(huge_pages);
+  }
+  
+  void setScratchDir(const std::string& dir)
+  {
+    TexArena::setScratchDir(dir);
+  }
+  
   H3DRes getTexRes(int tex)
   {
-    if(_texture_capacity <= tex || _textures[tex].first == nullptr)
+    _await(tex);
+    if(_inst->texture_capacity <= tex || _inst->textures[tex].first == nullptr)
       throw tgException("%i is not a valid texture id", tex);
-    if(_textures[tex].second == 0)
+    if(_inst->textures[tex].second == 0)
     {
       _createResource(tex, _newTexResName());
     }
-    return _textures[tex].second;
+    return _inst->textures[tex].second;
   }
   
   //raw access
   void writeRawTexture(int tex, const uint8_t* data)
   {
+    _await(tex);
     _validateTextureHandle(tex);
-    TexOp::writeRawTexture(_textures[tex].first, data);
+    TexOp::writeRawTexture(_inst->textures[tex].first, data);
     _updateResourceMaybe(tex);
   }
   void writeRawTexture(int tex, const float* data)
   {
+    _await(tex);
     _validateTextureHandle(tex);
-    TexOp::writeRawTexture(_textures[tex].first, data);
+    TexOp::writeRawTexture(_inst->textures[tex].first, data);
     _updateResourceMaybe(tex);
   }
   void readRawTexture(uint8_t* dest, int tex)
   {
-    _validateTextureHandle(tex);
-    TexOp::readRawTexture(dest, _textures[tex].first);
+    _await(tex);
+    _validateSourceHandle(tex);
+    TexOp::readRawTexture(dest, _inst->textures[tex].first);
   }
   void readRawTexture(float* dest, int tex)
   {
-    _validateTextureHandle(tex);
-    TexOp::readRawTexture(dest, _textures[tex].first);
+    _await(tex);
+    _validateSourceHandle(tex);
+    TexOp::readRawTexture(dest, _inst->textures[tex].first);
   }
   void writeRawChannel(int tex, const uint8_t* data, std::bitset<4> mask)
   {
+    _await(tex);
     _validateTextureHandle(tex);
-    TexOp::writeRawChannel(_textures[tex].first, data, mask);
+    TexOp::writeRawChannel(_inst->textures[tex].first, data, mask);
     _updateResourceMaybe(tex);
   }
   void writeRawChannel(int tex, const float* data, std::bitset<4> mask)
   {
+    _await(tex);
     _validateTextureHandle(tex);
-    TexOp::writeRawChannel(_textures[tex].first, data, mask);
+    TexOp::writeRawChannel(_inst->textures[tex].first, data, mask);
     _updateResourceMaybe(tex);
   }
   void readRawChannel(uint8_t* dest, int tex, int ch)
   {
-    _validateTextureHandle(tex);
-    TexOp::readRawChannel(dest, _textures[tex].first, ch);
+    _await(tex);
+    _validateSourceHandle(tex);
+    TexOp::readRawChannel(dest, _inst->textures[tex].first, ch);
   }
   void readRawChannel(float* dest, int tex, int ch)
   {
-    _validateTextureHandle(tex);
-    TexOp::readRawChannel(dest, _textures[tex].first, ch);
+    _await(tex);
+    _validateSourceHandle(tex);
+    TexOp::readRawChannel(dest, _inst->textures[tex].first, ch);
   }
   
   //clearing/blending/filtering
   void fillTexture(int tex, const std::array<float, 4> &color, std::bitset<4> mask)
   {
-    _validateTextureHandle(tex);
-    Eigen::Array4f col(color[0], color[1], color[2], color[3]);
-    if(mask.none())
+    _async({tex}, [=]()
     {
-      return;
-    }
-    else if(mask.all())
-    {
-      TexOp::clear(_textures[tex].first, col);
-    }
-    else
-    {
-      TexOp::clear(_textures[tex].first, col, mask);
-    }
-    _updateResourceMaybe(tex);
+      Eigen::Array4f col(color[0], color[1], color[2], color[3]);
+      TexOp::PointOps& ops = _pointOps(tex);
+      if(mask.none())
+        return;
+      ops.clear(col, mask);
+      _endPointOps(tex);
+    });
   }
   void fillBlended(int tex,
     const std::array<float, 4> &color, const std::array<float, 4> &blend)
   {
-    _validateTextureHandle(tex);
-    Eigen::Array4f col(color[0], color[1], color[2], color[3]);
-    Eigen::Array4f bld(blend[0], blend[1], blend[2], blend[3]);
-    TexOp::blend(_textures[tex].first, col, bld);
-    _updateResourceMaybe(tex);
+    _async({tex}, [=]()
+    {
+      Eigen::Array4f col(color[0], color[1], color[2], color[3]);
+      Eigen::Array4f bld(blend[0], blend[1], blend[2], blend[3]);
+      _pointOps(tex).blend(col, bld);
+      _endPointOps(tex);
+    });
   }
   
   void fillBackground(int tex, const std::array<float, 4>& color, std::bitset<4> mask)
   {
-    _validateTextureHandle(tex);
-    Eigen::Array4f col(color[0], color[1], color[2], color[3]);
-    TexOp::fillWithBlendChannel(
-      _textures[tex].first, mask, col, _textures[tex].first, 8);
-    _updateResourceMaybe(tex);
+    _async({tex}, [=]()
+    {
+      _validateTextureHandle(tex);
+      Eigen::Array4f col(color[0], color[1], color[2], color[3]);
+      TexOp::fillWithBlendChannel(
+        _inst->textures[tex].first, mask, col, _inst->textures[tex].first, 8);
+      _updateResourceMaybe(tex);
+    });
   }
   void fillWithAlphaCh(
     int tex, const std::array<float, 4>& color, std::bitset<4> mask, int src, int ch)
   {
-    _validateTextureHandle(tex);
-    _validateTextureHandle(src);
-    LinearInterpTexture src_c(src, tex);
-    Eigen::Array4f col(color[0], color[1], color[2], color[3]);
-    TexOp::fillWithRevBlendChannel(
-      _textures[tex].first, mask, col, src_c, ch);
-    _updateResourceMaybe(tex);
+    _async({tex, src}, [=]()
+    {
+      _validateTextureHandle(tex);
+      _validateSourceHandle(src);
+      LinearInterpTexture src_c(src, tex);
+      Eigen::Array4f col(color[0], color[1], color[2], color[3]);
+      TexOp::fillWithRevBlendChannel(
+        _inst->textures[tex].first, mask, col, src_c, ch);
+      _updateResourceMaybe(tex);
+    });
   }
   
   void filterTexture(int tex,
@@ -570,9 +1141,11 @@ namespace TextureManager
     float sm,
     std::bitset<4> mask)
   {
-    _validateTextureHandle(tex);
-    TexOp::filter(_textures[tex].first, co, li, sq, rs, sm, mask);
-    _updateResourceMaybe(tex);
+    _async({tex}, [=]()
+    {
+      _pointOps(tex).filter(co, li, sq, rs, sm, mask);
+      _endPointOps(tex);
+    });
   }
   void filterTextureLin(int tex,
     float from1,
@@ -581,9 +1154,11 @@ namespace TextureManager
     float to2,
     std::bitset<4> mask)
   {
-    _validateTextureHandle(tex);
-    TexOp::linearFilter(_textures[tex].first, from1, to1, from2, to2, mask);
-    _updateResourceMaybe(tex);
+    _async({tex}, [=]()
+    {
+      _pointOps(tex).linearFilter(from1, to1, from2, to2, mask);
+      _endPointOps(tex);
+    });
   }
   
   void filterTextureStencil(
@@ -592,9 +1167,11 @@ namespace TextureManager
     bool rev,
     std::bitset<4> mask)
   {
-    _validateTextureHandle(tex);
-    TexOp::stencilFilter(_textures[tex].first, cutof, rev, mask);
-    _updateResourceMaybe(tex);
+    _async({tex}, [=]()
+    {
+      _pointOps(tex).stencilFilter(cutof, rev, mask);
+      _endPointOps(tex);
+    });
   }
   
   void filterTextureDownsample(
@@ -602,270 +1179,391 @@ namespace TextureManager
     int levels,
     std::bitset<4> mask)
   {
-    _validateTextureHandle(tex);
-    TexOp::downsampleFilter(_textures[tex].first, levels, mask);
-    _updateResourceMaybe(tex);
+    _async({tex}, [=]()
+    {
+      _pointOps(tex).downsampleFilter(levels, mask);
+      _endPointOps(tex);
+    });
   }
   
   void channelDiff(int dest, int src, int ch, std::bitset<4> mask)
   {
-    _validateTextureHandle(dest);
-    if(dest == src)
-    {
-      TexOp::channelDiff(_textures[dest].first, _textures[src].first, ch, mask);
-    }
-    else
+    _async({dest, src}, [=]()
     {
-      _validateTextureHandle(src);
-      LinearInterpTexture src_t(src, dest);
-      TexOp::channelDiff(_textures[dest].first, src_t, ch, mask);
-    }
-    _updateResourceMaybe(dest);
+      _validateTextureHandle(dest);
+      if(dest == src)
+      {
+        TexOp::channelDiff(
+          _inst->textures[dest].first, _inst->textures[src].first, ch, mask);
+      }
+      else
+      {
+        _validateSourceHandle(src);
+        LinearInterpTexture src_t(src, dest);
+        TexOp::channelDiff(_inst->textures[dest].first, src_t, ch, mask);
+      }
+      _updateResourceMaybe(dest);
+    });
   }
   
   void textureDiff(int dest, int src, std::bitset<4> mask)
   {
-    _validateTextureHandle(dest);
-    if(dest == src)
-    {
-      TexOp::textureDiff(_textures[dest].first, _textures[src].first, mask);
-    }
-    else
+    _async({dest, src}, [=]()
     {
-      _validateTextureHandle(src);
-      LinearInterpTexture src_t(src, dest);
-      TexOp::textureDiff(_textures[dest].first, src_t, mask);
-    }
-    _updateResourceMaybe(dest);
+      _validateTextureHandle(dest);
+      if(dest == src)
+      {
+        TexOp::textureDiff(
+          _inst->textures[dest].first, _inst->textures[src].first, mask);
+      }
+      else
+      {
+        _validateSourceHandle(src);
+        LinearInterpTexture src_t(src, dest);
+        TexOp::textureDiff(_inst->textures[dest].first, src_t, mask);
+      }
+      _updateResourceMaybe(dest);
+    });
   }
   
   void clampTexels(int tex, float min, float max, std::bitset<4> mask)
   {
-    _validateTextureHandle(tex);
-    TexOp::clamp(_textures[tex].first, min, max, mask);
-    _updateResourceMaybe(tex);
+    _async({tex}, [=]()
+    {
+      _pointOps(tex).clamp(min, max, mask);
+      _endPointOps(tex);
+    });
   }
   
   //texture operations
   void blendTextures(int dest, int src, std::bitset<4> mask, int ch)
   {
-    _validateTextureHandle(dest);
-    _validateTextureHandle(src);
-    LinearInterpTexture src_t(src, dest);
-    TexOp::blendTexturesWithAlpha(_textures[dest].first, src_t, mask, src_t, ch);
-    _updateResourceMaybe(dest);
+    _async({dest, src}, [=]()
+    {
+      _validateTextureHandle(dest);
+      _validateSourceHandle(src);
+      LinearInterpTexture src_t(src, dest);
+      TexOp::blendTexturesWithAlpha(
+        _inst->textures[dest].first, src_t, mask, src_t, ch);
+      _updateResourceMaybe(dest);
+    });
   }
   
   void blendTexturesWithCh(int dest, int src, std::bitset<4> mask, int b_tex, int ch)
   {
-    _validateTextureHandle(dest);
-    _validateTextureHandle(src);
-    _validateTextureHandle(b_tex);
-    LinearInterpTexture src_t(src, dest);
-    LinearInterpTexture blend_t(b_tex, dest);
-    TexOp::blendTexturesWithAlpha(_textures[dest].first, src_t, mask, blend_t, ch);
-    _updateResourceMaybe(dest);
+    _async({dest, src, b_tex}, [=]()
+    {
+      _validateTextureHandle(dest);
+      _validateSourceHandle(src);
+      _validateSourceHandle(b_tex);
+      LinearInterpTexture src_t(src, dest);
+      LinearInterpTexture blend_t(b_tex, dest);
+      TexOp::blendTexturesWithAlpha(
+        _inst->textures[dest].first, src_t, mask, blend_t, ch);
+      _updateResourceMaybe(dest);
+    });
   }
   
   void mergeTextures(int dest, int src, float blend, std::bitset<4> mask)
   {
-    _validateTextureHandle(dest);
-    _validateTextureHandle(src);
-    LinearInterpTexture src_t(src, dest);
-    TexOp::mergeTextures(_textures[dest].first, src_t, blend, mask);
-    _updateResourceMaybe(dest);
+    _async({dest, src}, [=]()
+    {
+      _validateTextureHandle(dest);
+      _validateSourceHandle(src);
+      LinearInterpTexture src_t(src, dest);
+      TexOp::mergeTextures(_inst->textures[dest].first, src_t, blend, mask);
+      _updateResourceMaybe(dest);
+    });
   }
   
   //channel operations
   void copyChannel(int dest, std::bitset<4> mask, int src, int ch)
   {
-    _validateTextureHandle(dest);
-    _validateTextureHandle(src);
-    LinearInterpTexture src_t(src, dest);
-    TexOp::copyChannel(_textures[dest].first, mask, src_t, ch);
-    _updateResourceMaybe(dest);
+    _async({dest, src}, [=]()
+    {
+      _validateTextureHandleAnyLayout(dest);
+      _validateSourceHandleAnyLayout(src);
+      if(_inst->textures[dest].first->planar() &&
+        _inst->textures[src].first->planar() && _areTexturesSameSize(dest, src))
+      {
+        TexOp::copyChannel(
+          _inst->textures[dest].first, mask, _inst->textures[src].first, ch);
+        _updateResourceMaybe(dest);
+        return;
+      }
+    
+      _validateTextureHandle(dest);
+      _validateSourceHandle(src);
+      LinearInterpTexture src_t(src, dest);
+      TexOp::copyChannel(_inst->textures[dest].first, mask, src_t, ch);
+      _updateResourceMaybe(dest);
+    });
   }
   
   void blendChannels(int dest, std::bitset<4> mask, int src, int ch, float blend)
   {
-    _validateTextureHandle(dest);
-    _validateTextureHandle(src);
-    LinearInterpTexture src_t(src, dest);
-    TexOp::blendChannels(_textures[dest].first, mask, src_t, ch, blend);
-    _updateResourceMaybe(dest);
+    _async({dest, src}, [=]()
+    {
+      _validateTextureHandle(dest);
+      _validateSourceHandle(src);
+      LinearInterpTexture src_t(src, dest);
+      TexOp::blendChannels(_inst->textures[dest].first, mask, src_t, ch, blend);
+      _updateResourceMaybe(dest);
+    });
   }
   
   void swapChannels(int dest, int dch, int src, int sch)
   {
-    _validateTextureHandle(dest);
-    _validateTextureHandle(src);
-    LinearInterpTexture src_t(src, dest);
-    TexOp::swapChannels(_textures[dest].first, dch, src_t, sch);
-    _updateResourceMaybe(dest);
+    _async({dest, src}, [=]()
+    {
+      _validateTextureHandle(dest);
+      _validateTextureHandle(src);
+      //swapping writes to src_t, so the copy must not be cached
+      LinearInterpTexture src_t(src, dest, false);
+      TexOp::swapChannels(_inst->textures[dest].first, dch, src_t, sch);
+      _updateResourceMaybe(dest);
+      if(!src_t.did_interp)
+        _updateResourceMaybe(src);
+    });
   }
   
   int warpTexture(int src, int dmap, float mult)
   {
-    _validateTextureHandle(src);
-    _validateTextureHandle(dmap);
+    _await(src);
+    _await(dmap);
+    _validateSourceHandle(src);
+    _validateSourceHandle(dmap);
     LinearInterpTexture dmap_t(dmap, src);
     Texture* targ = makeTexture(
-      _textures[src].first->width, _textures[src].first->height);
-    TexOp::displaceMap(targ, _textures[src].first, dmap_t, mult);
+      _inst->textures[src].first->width, _inst->textures[src].first->height);
+    TexOp::displaceMap(targ, _inst->textures[src].first, dmap_t, mult);
     return _storeTexture(targ);
   }
   
   void warpTextureInplace(int tex, int dmap, float mult)
   {
-    _validateTextureHandle(tex);
-    _validateTextureHandle(dmap);
-    LinearInterpTexture dmap_t(dmap, tex);
-    Texture* targ = makeTexture(
-      _textures[tex].first->width, _textures[tex].first->height);
-    TexOp::displaceMap(targ, _textures[tex].first, dmap_t, mult);
-    _replaceTexture(targ, tex);
+    _async({tex, dmap}, [=]()
+    {
+      _validateSourceHandle(tex);
+      _validateSourceHandle(dmap);
+      LinearInterpTexture dmap_t(dmap, tex);
+      Texture* targ = makeTexture(
+        _inst->textures[tex].first->width, _inst->textures[tex].first->height);
+      TexOp::displaceMap(targ, _inst->textures[tex].first, dmap_t, mult);
+      _replaceTexture(targ, tex);
+    });
   }
   
   int shiftTexels(int tex, float x_shift, float y_shift)
   {
-    _validateTextureHandle(tex);
+    _await(tex);
+    _validateSourceHandle(tex);
     Texture* targ = makeTexture(
-      _textures[tex].first->width, _textures[tex].first->height);
-    TexOp::shiftTexels(targ, _textures[tex].first, x_shift, y_shift);
+      _inst->textures[tex].first->width, _inst->textures[tex].first->height);
+    TexOp::shiftTexels(targ, _inst->textures[tex].first, x_shift, y_shift);
     return _storeTexture(targ);
   }
   
   void shiftTexelsInplace(int tex, float x_shift, float y_shift)
   {
-    _validateTextureHandle(tex);
-    Texture* targ = makeTexture(
-      _textures[tex].first->width, _textures[tex].first->height);
-    TexOp::shiftTexels(targ, _textures[tex].first, x_shift, y_shift);
-    _replaceTexture(targ, tex);
+    _async({tex}, [=]()
+    {
+      _validateSourceHandle(tex);
+      Texture* targ = makeTexture(
+        _inst->textures[tex].first->width, _inst->textures[tex].first->height);
+      TexOp::shiftTexels(targ, _inst->textures[tex].first, x_shift, y_shift);
+      _replaceTexture(targ, tex);
+    });
   }
   
   int applyLens(int lens, int tex)
   {
-    _validateTextureHandle(lens);
-    _validateTextureHandle(tex);
-    Texture* targ = makeTexture(*_textures[lens].first);
-    TexOp::sampleMap(targ, _textures[tex].first);
+    _await(lens);
+    _await(tex);
+    _validateSourceHandle(lens);
+    _validateSourceHandle(tex);
+    Texture* targ = makeTexture(*_inst->textures[lens].first);
+    TexOp::sampleMap(targ, _inst->textures[tex].first);
     return _storeTexture(targ);
   }
   
   void applyLensInplace(int lens, int tex)
   {
-    _validateTextureHandle(lens);
-    _validateTextureHandle(tex);
-    TexOp::sampleMap(_textures[lens].first, _textures[tex].first);
-    _updateResourceMaybe(lens);
+    _async({lens, tex}, [=]()
+    {
+      _validateTextureHandle(lens);
+      _validateSourceHandle(tex);
+      TexOp::sampleMap(_inst->textures[lens].first, _inst->textures[tex].first);
+      _updateResourceMaybe(lens);
+    });
   }
   
-  int blurTexture(int tex, int f_width, int f_height, float f, std::bitset<4> mask)
+  //box blurs take any level
+  void _checkBlurLevels(int f_width, int f_height, bool box)
   {
-    _validateTextureHandle(tex);
-    Texture* targ = makeTexture(
-      _textures[tex].first->width, _textures[tex].first->height);
+    if(!box && (f_width > (int)BlurFilter1d::max_level ||
+      f_height > (int)BlurFilter1d::max_level))
+      throw tgException("blur level exceeds %u", BlurFilter1d::max_level);
+  }
+  
+  //the blurred texture, tex is left as it is
+  Texture* _blur(
+    Texture* tex, int f_width, int f_height, float f, std::bitset<4> mask, bool box)
+  {
+    Texture* targ = makeTexture(tex->width, tex->height);
     
-    switch((f_width == 0? 1 : 0) + (f_height == 0? 2 : 0))
+    switch((f_width == 0? 1 : 0) + (f_height == 0? 2 : 0) + (box? 4 : 0))
     {
+    case 4:
+    case 5:
+    case 6:
+      TexOp::boxBlur(targ, tex, f_width, f_height, f, mask);
+      break;
     case 0:
       {
-        BlurFilter2d filter = BlurFilter1d(f_width) * BlurFilter1d(f_height);
-        TexOp::blur(targ, _textures[tex].first, &filter, f, mask);
+        BlurFilter1d filter_x(f_width);
+        BlurFilter1d filter_y(f_height);
+        TexOp::blurSeparable(targ, tex, &filter_x, &filter_y, f, mask);
       }
       break;
     case 1:
       {
         BlurFilter1d filter(f_height);
-        TexOp::blurVertic(targ, _textures[tex].first, &filter, f, mask);
+        TexOp::blurVertic(targ, tex, &filter, f, mask);
       }
       break;
     case 2:
       {
         BlurFilter1d filter(f_width);
-        TexOp::blurHoriz(targ, _textures[tex].first, &filter, f, mask);
+        TexOp::blurHoriz(targ, tex, &filter, f, mask);
       }
       break;
     case 3:
-      TexOp::copyTexture(targ, _textures[tex].first, 0xf);
+    case 7:
+      TexOp::copyTexture(targ, tex, 0xf);
     }
     
-    return _storeTexture(targ);
+    return targ;
   }
   
-  void blurInplace(int tex, int f_width, int f_height, float f, std::bitset<4> mask)
+  int blurTexture(
+    int tex, int f_width, int f_height, float f, std::bitset<4> mask, bool box)
   {
-    _validateTextureHandle(tex);
-    Texture* targ = makeTexture(
-      _textures[tex].first->width, _textures[tex].first->height);
+    _checkBlurLevels(f_width, f_height, box);
+    _await(tex);
+    _validateSourceHandle(tex);
+    Texture* src = _inst->textures[tex].first;
     
-    switch((f_width == 0? 1 : 0) + (f_height == 0? 2 : 0))
-    {
-    case 0:
-      {
-        BlurFilter2d filter = BlurFilter1d(f_width) * BlurFilter1d(f_height);
-        TexOp::blur(targ, _textures[tex].first, &filter, f, mask);
-      }
-      break;
-    case 1:
+    if(f_width == 0 && f_height == 0)
+      return _storeTexture(_blur(src, f_width, f_height, f, mask, box));
+    return _storeTexture(_cachedResult("blur", tex,
+      [=](ResultCache::Hasher& hasher)
       {
-        BlurFilter1d filter(f_height);
-        TexOp::blurVertic(targ, _textures[tex].first, &filter, f, mask);
-      }
-      break;
-    case 2:
+        hasher << f_width << f_height << f << mask << box;
+      },
+      [=]()
       {
-        BlurFilter1d filter(f_width);
-        TexOp::blurHoriz(targ, _textures[tex].first, &filter, f, mask);
-      }
-      break;
-    case 3:
-      deleteTexture(targ);
-      return;
-    }
-    
-    _replaceTexture(targ, tex);
+        return _blur(src, f_width, f_height, f, mask, box);
+      }));
+  }
+  
+  void blurInplace(
+    int tex, int f_width, int f_height, float f, std::bitset<4> mask, bool box)
+  {
+    _checkBlurLevels(f_width, f_height, box);
+    _async({tex}, [=]()
+    {
+      _validateSourceHandle(tex);
+      if(f_width == 0 && f_height == 0)
+        return;
+      Texture* src = _inst->textures[tex].first;
+      
+      _replaceTexture(_cachedResult("blur", tex,
+        [=](ResultCache::Hasher& hasher)
+        {
+          hasher << f_width << f_height << f << mask << box;
+        },
+        [=]()
+        {
+          return _blur(src, f_width, f_height, f, mask, box);
+        }), tex);
+    });
   }
   
+  //the generator keys are drawn from the device right away, so the noise doesn't
+  //depend on the order tasks run in
   void generateNoise(int tex, int dev, std::bitset<4> mask)
   {
-    _validateTextureHandle(tex);
     if(Rand::getDevice(dev) == nullptr)
       throw tgException("random device %i not initialized", dev);
-    TexOp::generateNoise(_textures[tex].first, dev, mask);
-    _updateResourceMaybe(tex);
+    Rand::Philox rng = Rand::makePhilox(dev);
+    _async({tex}, [=]()
+    {
+      _validateTextureHandle(tex);
+      TexOp::generateNoise(_inst->textures[tex].first, rng, mask);
+      _updateResourceMaybe(tex);
+    });
   }
   
   void generateWhiteNoise(int tex, int dev, std::bitset<4> mask)
   {
-    _validateTextureHandle(tex);
     if(Rand::getDevice(dev) == nullptr)
       throw tgException("random device %i not initialized", dev);
-    TexOp::generateWhiteNoise(_textures[tex].first, dev, mask);
-    _updateResourceMaybe(tex);
+    Rand::Philox rng = Rand::makePhilox(dev);
+    _async({tex}, [=]()
+    {
+      _validateTextureHandleAnyLayout(tex);
+      TexOp::generateWhiteNoise(_inst->textures[tex].first, rng, mask);
+      _updateResourceMaybe(tex);
+    });
   }
   
   int makeTurbulence(int tex, int levels, float persistance, std::bitset<4> mask)
   {
+    _await(tex);
     assert(levels > 0);
     assert(persistance > 0.);
-    _validateTextureHandle(tex);
-    Texture* targ = makeTexture(_textures[tex].first->width,
-      _textures[tex].first->height);
-    TexOp::makeTurbulence(targ, _textures[tex].first, levels, persistance, mask);
-    return _storeTexture(targ);
+    _validateSourceHandle(tex);
+    if(levels > 31 || (_inst->textures[tex].first->width >> (levels - 1)) == 0 ||
+      (_inst->textures[tex].first->height >> (levels - 1)) == 0)
+      throw tgException("too many levels for texture size");
+    Texture* src = _inst->textures[tex].first;
+    return _storeTexture(_cachedResult("turbulence", tex,
+      [=](ResultCache::Hasher& hasher)
+      {
+        hasher << levels << persistance << mask;
+      },
+      [=]()
+      {
+        Texture* targ = makeTexture(src->width, src->height);
+        TexOp::makeTurbulence(targ, src, levels, persistance, mask);
+        return targ;
+      }));
   }
   
   void makeTurbulenceInplace(int tex, int levels, float persistance, std::bitset<4> mask)
   {
-    assert(levels > 0);
-    assert(persistance > 0.);
-    _validateTextureHandle(tex);
-    Texture* targ = makeTexture(_textures[tex].first->width,
-      _textures[tex].first->height);
-    TexOp::makeTurbulence(targ, _textures[tex].first, levels, persistance, mask);
-    _replaceTexture(targ, tex);
+    _async({tex}, [=]()
+    {
+      assert(levels > 0);
+      assert(persistance > 0.);
+      _validateSourceHandle(tex);
+      if(levels > 31 || (_inst->textures[tex].first->width >> (levels - 1)) == 0 ||
+        (_inst->textures[tex].first->height >> (levels - 1)) == 0)
+        throw tgException("too many levels for texture size");
+      Texture* src = _inst->textures[tex].first;
+      _replaceTexture(_cachedResult("turbulence", tex,
+        [=](ResultCache::Hasher& hasher)
+        {
+          hasher << levels << persistance << mask;
+        },
+        [=]()
+        {
+          Texture* targ = makeTexture(src->width, src->height);
+          TexOp::makeTurbulence(targ, src, levels, persistance, mask);
+          return targ;
+        }), tex);
+    });
   }
   
   void makeCellNoise(int tex,
@@ -873,12 +1571,23 @@ namespace TextureManager
     float range,
     std::array<int, 4>& mask)
   {
-    _validateTextureHandle(tex);
     if(std::any_of(__range(ps), [](std::pair<double, double>& p)
     {return p.first < 0. || p.first > 1. || p.second < 0. || p.second > 1.;}))
       throw tgException("malformed point-set");
-    TexOp::makeCellNoise(_textures[tex].first, ps, range, mask);
-    _updateResourceMaybe(tex);
+    _async({tex}, [=]() mutable
+    {
+      _validateTextureHandle(tex);
+      _cachedInplace("cellNoise", tex,
+        [&](ResultCache::Hasher& hasher)
+        {
+          hasher << ps << range << mask;
+        },
+        [&]()
+        {
+          TexOp::makeCellNoise(_inst->textures[tex].first, ps, range, mask);
+        });
+      _updateResourceMaybe(tex);
+    });
   }
   
   void makeDelaunay(int tex,
@@ -886,12 +1595,23 @@ namespace TextureManager
     float range,
     std::bitset<4> mask)
   {
-    _validateTextureHandle(tex);
     if(std::any_of(__range(ps), [](std::pair<double, double>& p)
     {return p.first < 0. || p.first > 1. || p.second < 0. || p.second > 1.;}))
       throw tgException("malformed point-set");
-    TexOp::makeDelaunay(_textures[tex].first, ps, range, mask);
-    _updateResourceMaybe(tex);
+    _async({tex}, [=]() mutable
+    {
+      _validateTextureHandle(tex);
+      _cachedInplace("delaunay", tex,
+        [&](ResultCache::Hasher& hasher)
+        {
+          hasher << ps << range << mask;
+        },
+        [&]()
+        {
+          TexOp::makeDelaunay(_inst->textures[tex].first, ps, range, mask);
+        });
+      _updateResourceMaybe(tex);
+    });
   }
   
   void makeVoronoi(int tex,
@@ -899,30 +1619,45 @@ namespace TextureManager
     float range,
     std::bitset<4> mask)
   {
-    _validateTextureHandle(tex);
     if(std::any_of(__range(ps), [](std::pair<double, double>& p)
     {return p.first < 0. || p.first > 1. || p.second < 0. || p.second > 1.;}))
       throw tgException("malformed point-set");
-    TexOp::makeVoronoi(_textures[tex].first, ps, range, mask);
-    _updateResourceMaybe(tex);
+    _async({tex}, [=]() mutable
+    {
+      _validateTextureHandle(tex);
+      _cachedInplace("voronoi", tex,
+        [&](ResultCache::Hasher& hasher)
+        {
+          hasher << ps << range << mask;
+        },
+        [&]()
+        {
+          TexOp::makeVoronoi(_inst->textures[tex].first, ps, range, mask);
+        });
+      _updateResourceMaybe(tex);
+    });
   }
   
   void makeNormalMap(int tex, double mul)
   {
-    _validateTextureHandle(tex);
-    TexOp::makeNormalMap(_textures[tex].first, mul);
-    _updateResourceMaybe(tex);
+    _async({tex}, [=]()
+    {
+      _validateTextureHandleAnyLayout(tex);
+      TexOp::makeNormalMap(_inst->textures[tex].first, mul);
+      _updateResourceMaybe(tex);
+    });
   }
   
   void writeToDisk(int tex, const char* filename)
   {
-    _validateTextureHandle(tex);
+    _await(tex);
+    _validateSourceHandle(tex);
     
     FILE* file = fopen(filename, "w");
     if(file == nullptr)
       throw tgException("unable to open file \'%s\'", filename);
     
-    Texture* texh = _textures[tex].first;
+    Texture* texh = _inst->textures[tex].first;
     char *d_ref;
     uint32_t size = texh->width * texh->height;
 
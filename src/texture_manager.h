@@ -2,14 +2,30 @@
 #define TEXTURE_MANAGER_H_INCLUDED
 
 #include "texture.h"
+#include "tex_op.h"
+#include "tex_arena.h"
 
 namespace TextureManager
 {
   void init();
   void deinit();
+  
+  /*
+    the textures, their handles and the modes belong to an instance. init creates
+    the default instance and makes it current on the calling thread, any other
+    thread must make an instance current before calling the functions below.
+    instances share nothing but the thread pool, so threads with instances of
+    their own can run scripts concurrently.
+  */
+  struct Instance;
+  Instance* createInstance();
+  //waits for the tasks of the instance and deletes it's textures
+  void destroyInstance(Instance*);
+  //makes the instance current on the calling thread, returns the previous one
+  Instance* setInstance(Instance*);
 
   int addTexture(H3DRes);
-  int addTexture(int, int);
+  int addTexture(int, int, TexHeader::Format = TexHeader::Format::Float);
   int cloneTexture(int);
   void copyTexture(int, int, std::bitset<4>);
   void swapTextures(int, int, std::bitset<4>);
@@ -58,11 +74,45 @@ namespace TextureManager
   int applyLens(int, int);
   void applyLensInplace(int, int);
   
-  int blurTexture(int, int, int, float, std::bitset<4>);
-  void blurInplace(int, int, int, float, std::bitset<4>);
+  int blurTexture(int, int, int, float, std::bitset<4>, bool box = false);
+  void blurInplace(int, int, int, float, std::bitset<4>, bool box = false);
   
-  void resizeTexture(int, unsigned, unsigned);
+  void resizeTexture(int, unsigned, unsigned,
+    TexOp::ResizeFilter = TexOp::ResizeFilter::Bilinear);
   decltype(TexHeader().getDimensions()) getTextureDimensions(int);
+  void setTextureLayout(int, TexHeader::Layout);
+  
+  //in deferred mode the pointwise functions (fillTexture, fillBlended, the filters
+  //and clampTexels) are run when the texture is next used, chains of them fused
+  //into one pass. leaving deferred mode runs everything pending.
+  void setDeferred(bool);
+  //in async mode the functions writing to existing textures return right away and
+  //run on the thread pool, ordered by the textures they use. everything else waits
+  //for the textures it uses, and throws the errors of earlier calls.
+  void setAsync(bool);
+  
+  //packs the textures with a reduced precision format which were used since the
+  //last call
+  void packTextures();
+  //updates the resources of the textures written since the last call, writes are
+  //not visible in horde3d until then
+  void flushTextures();
+  
+  //the memory of the textures of all instances (see TexArena). with a limit set
+  //(in bytes, 0 for none) functions needing more memory throw. trimMemory returns
+  //the idle memory to the system.
+  TexArena::Stats getMemoryStats();
+  void setMemoryLimit(size_t);
+  void trimMemory();
+  /*
+    puts large textures on huge pages (see TexArena), and pins the workers of the
+    thread pool to a cpu each, with the memory of new textures first touched by
+    the workers which will process it.
+  */
+  void setHugePages(bool);
+  //textures not fitting under the memory limit are put in files in the directory
+  //(see TexArena), an empty directory for none
+  void setScratchDir(const std::string&);
   
   void generateNoise(int, int, std::bitset<4>);
   void generateWhiteNoise(int, int, std::bitset<4>);
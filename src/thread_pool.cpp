@@ -0,0 +1,276 @@
+#include "thread_pool.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+  //index of the queue owned by the current thread, threads not in a pool use 0
+  thread_local int _tl_queue = 0;
+
+#ifdef __linux__
+  //the cpus the process may run on, taken before any worker is pinned
+  const cpu_set_t& _processCpus()
+  {
+    static cpu_set_t cpus = []()
+    {
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      if(sched_getaffinity(0, sizeof(cpus), &cpus) != 0)
+        CPU_SET(0, &cpus);
+      return cpus;
+    }();
+    return cpus;
+  }
+#endif
+}
+
+int ThreadPool::_queueIndex()
+{
+  return _tl_queue;
+}
+
+ThreadPool::Client::Client(ThreadPool& pool): _pool(pool), _queue(-1), _prev(_tl_queue)
+{
+  for(int i = 0; i < pool._num_clients; ++i)
+  {
+    bool taken = false;
+    if(pool._client_taken[i].compare_exchange_strong(taken, true))
+    {
+      _queue = i;
+      _tl_queue = pool._num_workers + 1 + i;
+      return;
+    }
+  }
+}
+
+ThreadPool::Client::~Client()
+{
+  if(_queue < 0)
+    return;
+  _tl_queue = _prev;
+  _pool._client_taken[_queue] = false;
+}
+
+bool ThreadPool::_pop(int q, _Job* job)
+{
+  std::lock_guard<std::mutex> lock(_queues[q].lock);
+  if(_queues[q].jobs.empty())
+    return false;
+  *job = _queues[q].jobs.back();
+  _queues[q].jobs.pop_back();
+  _queued.fetch_sub(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool ThreadPool::_steal(int q, _Job* job)
+{
+  int num_queues = _num_workers + _num_clients + 1;
+  for(int i = 1; i < num_queues; ++i)
+  {
+    int victim = (q + i) % num_queues;
+    std::lock_guard<std::mutex> lock(_queues[victim].lock);
+    if(_queues[victim].jobs.empty())
+      continue;
+    *job = _queues[victim].jobs.front();
+    _queues[victim].jobs.pop_front();
+    _queued.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+  return false;
+}
+
+bool ThreadPool::_acquire(int q, _Job* job)
+{
+  if(_queued.load(std::memory_order_relaxed) <= 0)
+    return false;
+  return _pop(q, job) || _steal(q, job);
+}
+
+void ThreadPool::_execute(const _Job& job)
+{
+  Batch* batch = job.batch;
+  batch->_task(batch->_ctx, job.from, job.to);
+  //the batch may be destroyed as soon as _pending reaches zero
+  if(batch->_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+  {
+    std::lock_guard<std::mutex> lock(_done_lock);
+    _done_cond.notify_all();
+  }
+}
+
+void ThreadPool::_workerMain(int q)
+{
+  _tl_queue = q;
+  _Job job;
+  for(;;)
+  {
+    if(_acquire(q, &job))
+    {
+      _execute(job);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(_park_lock);
+    _park_cond.wait(lock, [this]()
+      {return _stopping || _queued.load(std::memory_order_relaxed) > 0;});
+    if(_stopping && _queued.load(std::memory_order_relaxed) <= 0)
+      return;
+  }
+}
+
+void ThreadPool::_pin(int worker)
+{
+#ifdef __linux__
+  const cpu_set_t& cpus = _processCpus();
+  cpu_set_t mask = cpus;
+  if(_pinned)
+  {
+    //the caller runs slice 0, worker i slice i + 1
+    int n = (worker + 1) % CPU_COUNT(&cpus);
+    CPU_ZERO(&mask);
+    for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+      if(CPU_ISSET(cpu, &cpus) && n-- == 0)
+      {
+        CPU_SET(cpu, &mask);
+        break;
+      }
+  }
+  pthread_setaffinity_np(_threads[worker].native_handle(), sizeof(mask), &mask);
+#endif
+}
+
+void ThreadPool::pinWorkers(bool pinned)
+{
+#ifdef __linux__
+  _processCpus();
+#endif
+  _pinned = pinned;
+  for(int i = 0; i < _num_workers; ++i)
+    _pin(i);
+}
+
+void ThreadPool::start(int num_workers, int num_clients)
+{
+  stop();
+
+  if(num_workers < 0) num_workers = 0;
+  if(num_clients < 0) num_clients = 0;
+  _num_workers = num_workers;
+  _num_clients = num_clients;
+  _stopping = false;
+  _queues.reset(new _Queue[num_workers + num_clients + 1]);
+  _client_taken.reset(new std::atomic<bool>[num_clients]);
+  for(int i = 0; i < num_clients; ++i)
+    _client_taken[i] = false;
+  _threads.reset(new std::thread[num_workers]);
+  for(int i = 0; i < num_workers; ++i)
+    _threads[i] = std::thread(&ThreadPool::_workerMain, this, i + 1);
+  if(_pinned)
+    for(int i = 0; i < num_workers; ++i)
+      _pin(i);
+}
+
+void ThreadPool::stop() noexcept
+{
+  if(!_threads)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(_park_lock);
+    _stopping = true;
+  }
+  _park_cond.notify_all();
+  for(int i = 0; i < _num_workers; ++i)
+    _threads[i].join();
+
+  _threads = nullptr;
+  _queues = nullptr;
+  _client_taken = nullptr;
+  _num_workers = 0;
+  _num_clients = 0;
+}
+
+void ThreadPool::submit(Batch* batch, int from, int to, int slices)
+{
+  int range = to - from;
+  if(range <= 0)
+    return;
+  if(slices > range) slices = range;
+  if(slices < 1) slices = 1;
+
+  batch->_pending.fetch_add(slices, std::memory_order_relaxed);
+
+  //slice k goes to queue (q + k), so the submitting thread keeps the first slice.
+  //clients keep their slices apart from the other threads outside the pool
+  int q = _queueIndex();
+  for(int k = 0; k < slices; ++k)
+  {
+    _Job job;
+    job.batch = batch;
+    job.from = from + (int)((long long)range * k / slices);
+    job.to = from + (int)((long long)range * (k + 1) / slices);
+
+    int target;
+    if(q <= _num_workers)
+      target = (q + k) % (_num_workers + 1);
+    else if(k == 0 || _num_workers == 0)
+      target = q;
+    else
+      target = 1 + (q + k) % _num_workers;
+
+    _Queue& queue = _queues[target];
+    std::lock_guard<std::mutex> lock(queue.lock);
+    queue.jobs.push_back(job);
+  }
+  _queued.fetch_add(slices, std::memory_order_relaxed);
+
+  if(_num_workers > 0)
+  {
+    {
+      std::lock_guard<std::mutex> lock(_park_lock);
+      _park_cond.notify_all();
+    }
+    //threads blocked in wait can help out with the new jobs
+    std::lock_guard<std::mutex> lock(_done_lock);
+    _done_cond.notify_all();
+  }
+}
+
+void ThreadPool::wait(Batch* batch)
+{
+  int q = _queueIndex();
+  _Job job;
+  while(!batch->done())
+  {
+    if(_acquire(q, &job))
+    {
+      _execute(job);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(_done_lock);
+    _done_cond.wait(lock, [this, batch]()
+      {return batch->done() || _queued.load(std::memory_order_relaxed) > 0;});
+  }
+}
+
+void ThreadPool::waitUntil(const std::function<bool()>& done)
+{
+  int q = _queueIndex();
+  _Job job;
+  while(!done())
+  {
+    if(_acquire(q, &job))
+    {
+      _execute(job);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(_done_lock);
+    _done_cond.wait(lock, [this, &done]()
+      {return done() || _queued.load(std::memory_order_relaxed) > 0;});
+  }
+}
@@ -0,0 +1,146 @@
+#ifndef THREAD_POOL_H_INCLUDED
+#define THREAD_POOL_H_INCLUDED
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+
+/*
+  a pool of persistent worker threads.
+
+  work is submitted as batches. a batch is a task (function pointer plus context) and
+  a range of indices, split into jobs of [from, to) sub-ranges. each worker owns a
+  deque of jobs. a worker pops jobs from the back of it's own deque and steals from
+  the front of the other workers deques when it runs dry. idle workers park on a
+  condition variable until more work is submitted.
+
+  the thread calling wait takes part in executing jobs until the batch is done, so
+  waiting from inside a task is safe. waitUntil does the same until a condition
+  holds, the condition is checked again whenever a batch finishes.
+
+  threads outside the pool share one deque, unless they hold a Client. a client
+  gets a deque of it's own, which it pops from first while waiting, so threads
+  submitting concurrently each keep working on their own batches while the
+  workers spread over all of them.
+
+  pinned workers run on one cpu each, worker i on the (i + 1)th cpu the process may
+  run on, wrapping around. slice k of a batch submitted from outside the pool goes
+  to worker k, so memory first touched by a batch stays on the node of the cpu
+  which later runs the same slice.
+
+  note:
+    - tasks must not throw.
+    - a batch must outlive the call to wait.
+*/
+class ThreadPool
+{
+public:
+  typedef void (*Task)(void*, int, int);
+
+  class Batch
+  {
+    Task _task;
+    void* _ctx;
+    std::atomic<int> _pending;
+
+    friend class ThreadPool;
+
+  public:
+    Batch(Task task, void* ctx): _task(task), _ctx(ctx), _pending(0){}
+    Batch(const Batch&) = delete;
+    void operator=(const Batch&) = delete;
+
+    bool done() const
+    {
+      return _pending.load(std::memory_order_acquire) == 0;
+    }
+  };
+
+private:
+
+  struct _Job
+  {
+    Batch* batch;
+    int from, to;
+  };
+
+  struct _Queue
+  {
+    std::mutex lock;
+    std::deque<_Job> jobs;
+  };
+
+  //queue 0 belongs to threads not in the pool, queue i + 1 to worker i, the
+  //queues after those to the clients
+  std::unique_ptr<_Queue[]> _queues;
+  std::unique_ptr<std::thread[]> _threads;
+  int _num_workers = 0;
+  int _num_clients = 0;
+  std::unique_ptr<std::atomic<bool>[]> _client_taken;
+  bool _pinned = false;
+
+  std::atomic<int> _queued;
+  bool _stopping = false;
+
+  std::mutex _park_lock;
+  std::condition_variable _park_cond;
+  std::mutex _done_lock;
+  std::condition_variable _done_cond;
+
+  static int _queueIndex();
+
+  bool _pop(int, _Job*);
+  bool _steal(int, _Job*);
+  bool _acquire(int, _Job*);
+  void _execute(const _Job&);
+  void _workerMain(int);
+  void _pin(int);
+
+public:
+
+  //gives the thread creating it a queue of it's own while it lives, if one of
+  //the queues set aside by start is free
+  class Client
+  {
+    ThreadPool& _pool;
+    int _queue;
+    int _prev;
+
+  public:
+    Client(ThreadPool&);
+    Client(const Client&) = delete;
+    void operator=(const Client&) = delete;
+    ~Client();
+  };
+
+  //starts the workers, and sets aside queues for as many clients. the pool must
+  //not be started or stopped while it has clients.
+  void start(int, int = 0);
+  void stop() noexcept;
+  //kept over restarts, does nothing on systems without thread affinity
+  void pinWorkers(bool);
+
+  int workers() const
+  {
+    return _num_workers;
+  }
+
+  void submit(Batch*, int, int, int);
+  void wait(Batch*);
+  void waitUntil(const std::function<bool()>&);
+
+  ThreadPool(): _queued(0){}
+  ThreadPool(const ThreadPool&) = delete;
+  void operator=(const ThreadPool&) = delete;
+
+  ~ThreadPool()
+  {
+    stop();
+  }
+};
+
+#endif
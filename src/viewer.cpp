@@ -10,6 +10,7 @@
 #include "h3d.h"
 #include "terminal.h"
 #include "sq.h"
+#include "texture_manager.h"
 
 #include "viewer.h"
 
@@ -407,6 +408,16 @@ namespace Viewer
       }
     }
   
+    //uploads everything the scripts wrote since the last frame. in async mode this
+    //is where errors of tasks no script call waited for turn up
+    try
+    {
+      TextureManager::flushTextures();
+    }
+    catch(std::exception& e)
+    {
+      Terminal::printfm("flushTextures: %s\n", e.what());
+    }
     _render();
   }
   